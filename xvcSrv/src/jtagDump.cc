@@ -1,5 +1,6 @@
 #include <jtagDump.h>
 #include <stdio.h>
+#include <string.h>
 
 void
 JtagState_TestLogicReset::advance(JtagDumpCtx *context, int tms, int tdo, int tdi)
@@ -79,9 +80,7 @@ JtagState_Exit2DR::advance(JtagDumpCtx *context, int tms, int tdo, int tdi)
 void
 JtagState_UpdateDR::advance(JtagDumpCtx *context, int tms, int tdo, int tdi)
 {
-unsigned    bits = context->getDRLen();
-const char *mrk  = bits > sizeof(JtagRegType)*8 ? "*" : "";
-	fprintf(stderr, "%s: DR[IR = %llx] sent: 0x%s%llx, recv: 0x%s%llx (total %d bits)\n", getName(), context->getIRo(), mrk, context->getDRo(), mrk, context->getDRi(), bits);
+	context->scanDone( false );
 	if ( tms ) {
 		context->changeState( &context->state_SelectDRScan_ );
 	} else {
@@ -150,9 +149,7 @@ JtagState_Exit2IR::advance(JtagDumpCtx *context, int tms, int tdo, int tdi)
 void
 JtagState_UpdateIR::advance(JtagDumpCtx *context, int tms, int tdo, int tdi)
 {
-unsigned    bits = context->getIRLen();
-const char *mrk  = bits > sizeof(JtagRegType)*8 ? "*" : "";
-	fprintf(stderr, "%s: IR sent: 0x%llx%s, recv: 0x%s%llx (total %d bits)\n", getName(), context->getIRo(), mrk, mrk, context->getIRi(), bits);
+	context->scanDone( true );
 	if ( tms ) {
 		context->changeState( &context->state_SelectDRScan_ );
 	} else {
@@ -160,100 +157,315 @@ const char *mrk  = bits > sizeof(JtagRegType)*8 ? "*" : "";
 	}
 }
 
-JtagDumpCtx::JtagDumpCtx()
+// in the order of the 'state_' members
+enum {
+	TLR, RTI, SEL_DR, CAP_DR, SHF_DR, EX1_DR, PAU_DR, EX2_DR, UPD_DR,
+	          SEL_IR, CAP_IR, SHF_IR, EX1_IR, PAU_IR, EX2_IR, UPD_IR
+};
+
+JtagDumpCtx::Step JtagDumpCtx::steps_[JtagDumpCtx::NUM_STATES][256];
+bool              JtagDumpCtx::stepsInit_    = false;
+unsigned          JtagDumpCtx::defPrintBits_ = 64;
+
+unsigned char     JtagDumpCtx::cycleClass_[JtagDumpCtx::NUM_STATES] = {
+	/* TLR    */ JtagProfile::IDLE,
+	/* RTI    */ JtagProfile::IDLE,
+	/* SEL_DR */ JtagProfile::NAV,
+	/* CAP_DR */ JtagProfile::NAV,
+	/* SHF_DR */ JtagProfile::SHIFT_DR,
+	/* EX1_DR */ JtagProfile::NAV,
+	/* PAU_DR */ JtagProfile::NAV,
+	/* EX2_DR */ JtagProfile::NAV,
+	/* UPD_DR */ JtagProfile::NAV,
+	/* SEL_IR */ JtagProfile::NAV,
+	/* CAP_IR */ JtagProfile::NAV,
+	/* SHF_IR */ JtagProfile::SHIFT_IR,
+	/* EX1_IR */ JtagProfile::NAV,
+	/* PAU_IR */ JtagProfile::NAV,
+	/* EX2_IR */ JtagProfile::NAV,
+	/* UPD_IR */ JtagProfile::NAV,
+};
+
+void
+JtagReg::print(FILE *f, unsigned maxBits)
+{
+unsigned    n = ( 0 == maxBits || len_ < maxBits ) ? len_ : maxBits;
+int         w = (n + WORD_BITS - 1)/WORD_BITS - 1;
+unsigned    r = n - WORD_BITS*w;
+JtagRegType msk;
+
+	if ( n < len_ ) {
+		fputc( '*', f );
+	}
+	if ( 0 == n ) {
+		fputc( '0', f );
+		return;
+	}
+	msk = r < WORD_BITS ? (((JtagRegType)1) << r) - 1 : ~((JtagRegType)0);
+	fprintf( f, "%llx", words_[w] & msk );
+	while ( --w >= 0 ) {
+		fprintf( f, "%016llx", words_[w] );
+	}
+}
+
+unsigned
+JtagDumpCtx::nextState(unsigned idx, int tms)
+{
+static const unsigned char next[NUM_STATES][2] = {
+	/* TLR    */ { RTI,    TLR    },
+	/* RTI    */ { RTI,    SEL_DR },
+	/* SEL_DR */ { CAP_DR, SEL_IR },
+	/* CAP_DR */ { SHF_DR, EX1_DR },
+	/* SHF_DR */ { SHF_DR, EX1_DR },
+	/* EX1_DR */ { PAU_DR, UPD_DR },
+	/* PAU_DR */ { PAU_DR, EX2_DR },
+	/* EX2_DR */ { SHF_DR, UPD_DR },
+	/* UPD_DR */ { RTI,    SEL_DR },
+	/* SEL_IR */ { CAP_IR, TLR    },
+	/* CAP_IR */ { SHF_IR, EX1_IR },
+	/* SHF_IR */ { SHF_IR, EX1_IR },
+	/* EX1_IR */ { PAU_IR, UPD_IR },
+	/* PAU_IR */ { PAU_IR, EX2_IR },
+	/* EX2_IR */ { SHF_IR, UPD_IR },
+	/* UPD_IR */ { RTI,    SEL_DR },
+};
+	return next[idx][ !!tms ];
+}
+
+void
+JtagDumpCtx::initSteps()
 {
+unsigned s, tms, b, st;
+Step    *p;
+
+	for ( s = 0; s < NUM_STATES; s++ ) {
+		for ( tms = 0; tms < 256; tms++ ) {
+			p         = &steps_[s][tms];
+			p->shift_ = 0;
+			p->slow_  = 0;
+			p->idle_  = 0;
+			st        = s;
+			for ( b = 0; b < 8; b++ ) {
+				switch ( st ) {
+					case SHF_DR: case SHF_IR:
+						p->shift_ |= (1 << b);
+					break;
+					case CAP_DR: case CAP_IR: case UPD_DR: case UPD_IR:
+						p->slow_   = 1;
+					break;
+					case TLR: case RTI:
+						p->idle_++;
+					break;
+					default:
+					break;
+				}
+				st = nextState( st, tms & (1 << b) );
+			}
+			p->next_  = st;
+		}
+	}
+	stepsInit_ = true;
+}
+
+JtagDumpCtx::JtagDumpCtx(bool quiet)
+: quiet_    ( quiet         ),
+  printBits_( defPrintBits_ ),
+  handler_  ( 0             ),
+  prof_     ( 0             )
+{
+unsigned i;
+
+	states_[TLR   ] = &state_TestLogicReset_;
+	states_[RTI   ] = &state_RunTestIdle_;
+	states_[SEL_DR] = &state_SelectDRScan_;
+	states_[CAP_DR] = &state_CaptureDR_;
+	states_[SHF_DR] = &state_ShiftDR_;
+	states_[EX1_DR] = &state_Exit1DR_;
+	states_[PAU_DR] = &state_PauseDR_;
+	states_[EX2_DR] = &state_Exit2DR_;
+	states_[UPD_DR] = &state_UpdateDR_;
+	states_[SEL_IR] = &state_SelectIRScan_;
+	states_[CAP_IR] = &state_CaptureIR_;
+	states_[SHF_IR] = &state_ShiftIR_;
+	states_[EX1_IR] = &state_Exit1IR_;
+	states_[PAU_IR] = &state_PauseIR_;
+	states_[EX2_IR] = &state_Exit2IR_;
+	states_[UPD_IR] = &state_UpdateIR_;
+	for ( i = 0; i < NUM_STATES; i++ ) {
+		states_[i]->idx_ = i;
+	}
+
+	if ( ! stepsInit_ ) {
+		initSteps();
+	}
+
+	clearDR();
+	clearIR();
 	state_ = &state_TestLogicReset_;
 }
 
+bool
+JtagDumpCtx::isQuiet()
+{
+	return quiet_;
+}
+
+JtagState *
+JtagDumpCtx::getState()
+{
+	return state_;
+}
+
+bool
+JtagDumpCtx::isIdle()
+{
+	return state_ == &state_TestLogicReset_ || state_ == &state_RunTestIdle_;
+}
+
 void
 JtagDumpCtx::clearDR()
 {
-	dri_ = 0;
-	dro_ = 0;
-	drm_ = 1;
-	drl_ = 0;
+	dri_.clear();
+	dro_.clear();
 }
 
 void
 JtagDumpCtx::clearIR()
 {
-	iri_ = 0;
-	iro_ = 0;
-    irm_ = 1;
-	irl_ = 0;
+	iri_.clear();
+	iro_.clear();
 }
 
 unsigned
 JtagDumpCtx::getDRLen()
 {
-	return drl_;
+	return dri_.getLen();
 }
 
 unsigned
 JtagDumpCtx::getIRLen()
 {
-	return irl_;
+	return iri_.getLen();
 }
 
 void
 JtagDumpCtx::shiftDR(int tdo, int tdi)
 {
-#if 0
-	if ( 0 == drm_ ) {
-		fprintf(stderr,"WARNING: DR contents too long; upper bits not captured\n");
-	}
-#endif
-	if ( tdo )
-		dro_ |= drm_;
-	if ( tdi )
-		dri_ |= drm_;
-	drm_ <<= 1;
-	drl_++;
+	dro_.append( !!tdo, 1 );
+	dri_.append( !!tdi, 1 );
 }
 
 void
 JtagDumpCtx::shiftIR(int tdo, int tdi)
 {
-const JtagRegType msb = (((JtagRegType)1) << (sizeof(JtagRegType)*8 - 1));
-	if ( 0 == irm_ ) {
-		fprintf(stderr,"WARNING: IR contents too long; upper bits not captured\n");
-		iro_ = iro_ >> 1;
-		if ( tdo ) {
-			iro_ |= msb;
-		} else {
-			iro_ &= ~msb;
-		}
-	}
-	if ( tdo )
-		iro_ |= irm_;
-	if ( tdi )
-		iri_ |= irm_;
-	irm_ <<= 1;
-	irl_++;
+	iro_.append( !!tdo, 1 );
+	iri_.append( !!tdi, 1 );
 }
 
 JtagRegType
 JtagDumpCtx::getDRi()
 {
-	return dri_;
+	return dri_.getWord( 0 );
 }
 
 JtagRegType
 JtagDumpCtx::getDRo()
 {
-	return dro_;
+	return dro_.getWord( 0 );
 }
 
 JtagRegType
 JtagDumpCtx::getIRi()
 {
-	return iri_;
+	return iri_.getWord( 0 );
 }
 
 JtagRegType
 JtagDumpCtx::getIRo()
 {
-	return iro_;
+	return iro_.getWord( 0 );
+}
+
+JtagReg *
+JtagDumpCtx::getDRiReg()
+{
+	return &dri_;
+}
+
+JtagReg *
+JtagDumpCtx::getDRoReg()
+{
+	return &dro_;
+}
+
+JtagReg *
+JtagDumpCtx::getIRiReg()
+{
+	return &iri_;
+}
+
+JtagReg *
+JtagDumpCtx::getIRoReg()
+{
+	return &iro_;
+}
+
+void
+JtagDumpCtx::setPrintBits(unsigned maxBits)
+{
+	printBits_ = maxBits;
+}
+
+void
+JtagDumpCtx::setDefaultPrintBits(unsigned maxBits)
+{
+	defPrintBits_ = maxBits;
+}
+
+void
+JtagDumpCtx::setScanHandler(JtagScanHandler *h)
+{
+	handler_ = h;
+}
+
+void
+JtagDumpCtx::setProfile(JtagProfile *p)
+{
+	prof_ = p;
+}
+
+JtagProfile *
+JtagDumpCtx::getProfile()
+{
+	return prof_;
+}
+
+void
+JtagDumpCtx::scanDone(bool ir)
+{
+	if ( prof_ ) {
+		prof_->handleScan( this, ir );
+	}
+	// a quiet context doesn't capture (unless profiling)
+	if ( quiet_ ) {
+		return;
+	}
+	if ( ir ) {
+		fprintf(stderr, "%s: IR sent: 0x", state_->getName());
+		iro_.print( stderr, printBits_ );
+		fprintf(stderr, ", recv: 0x");
+		iri_.print( stderr, printBits_ );
+		fprintf(stderr, " (total %d bits)\n", getIRLen());
+	} else {
+		fprintf(stderr, "%s: DR[IR = %llx] sent: 0x", state_->getName(), getIRo());
+		dro_.print( stderr, printBits_ );
+		fprintf(stderr, ", recv: 0x");
+		dri_.print( stderr, printBits_ );
+		fprintf(stderr, " (total %d bits)\n", getDRLen());
+	}
+	if ( handler_ ) {
+		handler_->handleScan( this, ir );
+	}
 }
 
 void
@@ -273,25 +485,119 @@ JtagDumpCtx::advance(int tms, int tdo, int tdi)
 #if 0
 fprintf(stderr, "A(%d)\n", !!tms);
 #endif
+	if ( prof_ ) {
+		prof_->cycles_[ cycleClass_[ state_->idx_ ] ]++;
+	}
 	state_->advance(this, tms, tdo, tdi);
 }
 
+void
+JtagDumpCtx::shiftBits(bool ir, unsigned mask, unsigned tdo, unsigned tdi)
+{
+unsigned o, i, n, m;
+
+	if ( 0xff == mask ) {
+		// the common case; in Shift-xR for all 8 cycles
+		o = tdo;
+		i = tdi;
+		n = 8;
+	} else {
+		// gather the selected bits
+		for ( o = i = n = 0, m = 1; m < 0x100; m <<= 1 ) {
+			if ( mask & m ) {
+				o |= ( (tdo & m) ? 1 : 0 ) << n;
+				i |= ( (tdi & m) ? 1 : 0 ) << n;
+				n++;
+			}
+		}
+	}
+
+	if ( ir ) {
+		JtagReg::append( &iro_, o, &iri_, i, n );
+	} else {
+		JtagReg::append( &dro_, o, &dri_, i, n );
+	}
+}
+
+// 64 bits (LSB first, as in the XVC vectors)
+static JtagRegType
+getWord(const unsigned char *p)
+{
+JtagRegType v = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	memcpy( &v, p, sizeof(v) );
+#else
+int         i;
+
+	for ( i = 7; i >= 0; i-- ) {
+		v = (v << 8) | p[i];
+	}
+#endif
+	return v;
+}
+
 void
 JtagDumpCtx::processBuf(int nbits, unsigned char *tmsb, unsigned char *tdob, unsigned char *tdib)
 {
-unsigned n,m;
+unsigned    m, n, idx;
+const Step *s;
+bool        ir;
+bool        capture = ! quiet_ || prof_;
+
+	while ( nbits >= 8 ) {
+		idx = state_->idx_;
+		if ( 0 == *tmsb && nbits >= 64 && nextState( idx, 0 ) == idx && 0 == getWord( tmsb ) ) {
+			// TMS is low for 64 cycles and the state doesn't change (long
+			// scans, idle or pause); capture a word at a time
+			if ( prof_ ) {
+				prof_->cycles_[ cycleClass_[ idx ] ] += 64;
+			}
+			if ( capture && ( SHF_DR == idx || SHF_IR == idx ) ) {
+				if ( SHF_IR == idx ) {
+					JtagReg::append( &iro_, getWord( tdob ), &iri_, getWord( tdib ), 64 );
+				} else {
+					JtagReg::append( &dro_, getWord( tdob ), &dri_, getWord( tdib ), 64 );
+				}
+			}
+			tmsb  += 8;
+			tdob  += 8;
+			tdib  += 8;
+			nbits -= 64;
+			continue;
+		}
 
-	while ( nbits > 0 ) {
-		n = 1 << ( nbits < 8 ? nbits : 8 );
-		for ( m = 1; m < n; m <<= 1 ) {
-			advance( ((*tmsb) & m), ((*tdob) & m), ((*tdib) & m) );
+		s  = &steps_[ state_->idx_ ][ *tmsb ];
+		// shifting in a byte without Capture/Update never leaves the column
+		ir = state_->idx_ >= SEL_IR;
+		if ( s->slow_ ) {
+			// actions; do it bit by bit
+			for ( m = 1; m < 0x100; m <<= 1 ) {
+				advance( ((*tmsb) & m), ((*tdob) & m), ((*tdib) & m) );
+			}
+		} else {
+			if ( s->shift_ && capture ) {
+				shiftBits( ir, s->shift_, *tdob, *tdib );
+			}
+			if ( prof_ ) {
+				n = __builtin_popcount( s->shift_ );
+				prof_->cycles_[ ir ? JtagProfile::SHIFT_IR : JtagProfile::SHIFT_DR ] += n;
+				prof_->cycles_[ JtagProfile::IDLE ]                                 += s->idle_;
+				prof_->cycles_[ JtagProfile::NAV  ]                                 += 8 - n - s->idle_;
+			}
+			state_ = states_[ s->next_ ];
 		}
 
 		tmsb++;
 		tdob++;
 		tdib++;
-		
+
 		nbits -= 8;
 	}
 
+	if ( nbits > 0 ) {
+		n = 1 << nbits;
+		for ( m = 1; m < n; m <<= 1 ) {
+			advance( ((*tmsb) & m), ((*tdob) & m), ((*tdib) & m) );
+		}
+	}
 }
@@ -1,12 +1,113 @@
 #ifndef JTAG_DUMP_H
 #define JTAG_DUMP_H
 
+#include <stdio.h>
+#include <vector>
+
 typedef unsigned long long JtagRegType;
 
 class JtagDumpCtx;
 
+// A (DR or IR) register of arbitrary length. Clearing it retains the
+// storage; thus, once the longest scan has been seen, capturing no longer
+// allocates memory.
+class JtagReg {
+public:
+	static const unsigned WORD_BITS = sizeof(JtagRegType)*8;
+
+private:
+	std::vector<JtagRegType> words_;
+	unsigned                 len_;
+	// 'len_' up to which 'append' needs no more room
+	unsigned                 lim_;
+
+	void grow()
+	{
+		words_.resize( 2*words_.size() );
+		lim_ = (words_.size() - 1)*WORD_BITS;
+	}
+
+public:
+	JtagReg()
+	: words_( 2 ),
+	  len_  ( 0 ),
+	  lim_  ( WORD_BITS )
+	{
+		words_[0] = 0;
+	}
+
+	void clear()
+	{
+		len_      = 0;
+		words_[0] = 0;
+	}
+
+	unsigned getLen()
+	{
+		return len_;
+	}
+
+	unsigned getNumWords()
+	{
+		return (len_ + WORD_BITS - 1)/WORD_BITS;
+	}
+
+	// bits 'WORD_BITS*i' .. 'WORD_BITS*(i+1) - 1'; bits beyond the
+	// length are zero
+	JtagRegType getWord(unsigned i)
+	{
+		return i < getNumWords() ? words_[i] : 0;
+	}
+
+	// append the 'n' (<= WORD_BITS) least-significant bits of 'v'
+	// (the other bits of 'v' must be zero)
+	void append(JtagRegType v, unsigned n)
+	{
+	JtagRegType *p;
+	unsigned     b = len_ % WORD_BITS;
+
+		if ( len_ >= lim_ ) {
+			grow();
+		}
+		p     = &words_[ len_ / WORD_BITS ];
+		// the word following the current one is always (re-)initialized
+		// so that it is zero when we get there
+		p[0] |= v << b;
+		p[1]  = (v >> 1) >> (WORD_BITS - 1 - b);
+		len_ += n;
+	}
+
+	// append to two registers of equal length ('in' and 'out' of a scan)
+	static void append(JtagReg *a, JtagRegType va, JtagReg *b, JtagRegType vb, unsigned n)
+	{
+	JtagRegType *pa, *pb;
+	unsigned     w   = a->len_ / WORD_BITS;
+	unsigned     sh  = a->len_ % WORD_BITS;
+
+		if ( a->len_ >= a->lim_ ) {
+			a->grow();
+			b->grow();
+		}
+		pa     = &a->words_[w];
+		pb     = &b->words_[w];
+		pa[0] |= va << sh;
+		pb[0] |= vb << sh;
+		pa[1]  = (va >> 1) >> (WORD_BITS - 1 - sh);
+		pb[1]  = (vb >> 1) >> (WORD_BITS - 1 - sh);
+		a->len_ += n;
+		b->len_ += n;
+	}
+
+	// print (the least-significant 'maxBits' of) the contents in hex;
+	// a leading '*' marks truncated output. 'maxBits' = 0 prints all.
+	void print(FILE *f, unsigned maxBits);
+};
+
 class JtagState {
 public:
+	// index into the tracker's lookup tables (set by the context)
+	unsigned idx_;
+
 	virtual const char *getName()                                = 0;
 	virtual void advance(JtagDumpCtx *context, int tms, int tdo, int tdi) = 0;
 };
@@ -155,16 +256,83 @@ public:
 };
 
 
+// Notified of every completed scan (in Update-DR/Update-IR); the
+// registers hold the full scan
+class JtagScanHandler {
+public:
+	virtual void handleScan(JtagDumpCtx *context, bool ir) = 0;
+
+	virtual ~JtagScanHandler() {}
+};
+
+// Where the TCK cycles go (see JtagDumpCtx::setProfile()); scans are
+// passed to 'handleScan()'
+class JtagProfile : public JtagScanHandler {
+public:
+	typedef enum {
+		IDLE,     // Test-Logic-Reset, Run-Test/Idle
+		NAV,      // TMS-only navigation (Select, Capture, Exit, Pause, Update)
+		SHIFT_IR,
+		SHIFT_DR,
+		NUM_CLASSES
+	} CycleClass;
+
+	unsigned long long cycles_[NUM_CLASSES];
+
+	JtagProfile()
+	{
+	unsigned i;
+		for ( i = 0; i < NUM_CLASSES; i++ ) {
+			cycles_[i] = 0;
+		}
+	}
+
+	virtual void handleScan(JtagDumpCtx *, bool)
+	{
+	}
+};
+
+// The TAP is tracked a TMS byte at a time: a table indexed by the current
+// state and the TMS byte yields the state after these 8 TCK cycles and
+// the bits which were shifted into DR or IR (these are then appended to
+// the register in one go). Bytes that pass through a Capture or Update
+// state (where something must be done) are handed to the per-bit state
+// classes ('advance()') instead; these are rare compared to long shifts.
 class JtagDumpCtx {
+public:
+	static const unsigned NUM_STATES = 16;
+
+	typedef struct {
+		unsigned char next_;  // state after 8 TCK cycles
+		unsigned char shift_; // TCK cycles spent in Shift-DR/Shift-IR
+		unsigned char slow_;  // passes through Capture/Update
+		unsigned char idle_;  // number of TCK cycles in TLR/RTI
+	} Step;
+
 private:
-	unsigned    irl_, drl_;
-	JtagRegType iri_,dri_;
-	JtagRegType irm_,drm_;
-	JtagRegType iro_,dro_;
-	JtagState  *state_;
+	JtagReg          iri_,dri_;
+	JtagReg          iro_,dro_;
+	JtagState       *state_;
+	bool             quiet_;
+	unsigned         printBits_;
+	JtagScanHandler *handler_;
+	JtagProfile     *prof_;
+	JtagState       *states_[NUM_STATES];
+
+	static Step      steps_[NUM_STATES][256];
+	static unsigned char cycleClass_[NUM_STATES];
+	static bool      stepsInit_;
+	static unsigned  defPrintBits_;
+
+	static void initSteps();
+
+	// append the TDO/TDI bits selected by 'mask' to DR or IR
+	void shiftBits(bool ir, unsigned mask, unsigned tdo, unsigned tdi);
 
 public:
-	JtagDumpCtx();
+	// a 'quiet' context merely tracks the TAP state
+	// without printing the registers
+	JtagDumpCtx(bool quiet = false);
 
 	JtagState_TestLogicReset state_TestLogicReset_;
 	JtagState_RunTestIdle    state_RunTestIdle_;
@@ -187,18 +355,52 @@ public:
 	void clearIR();
 	void shiftDR(int tdo, int tdi);
 	void shiftIR(int tdo, int tdi);
+	// least-significant bits of the registers
 	JtagRegType getDRi();
 	JtagRegType getIRi();
 	JtagRegType getDRo();
 	JtagRegType getIRo();
 
+	// full registers
+	JtagReg *getDRiReg();
+	JtagReg *getIRiReg();
+	JtagReg *getDRoReg();
+	JtagReg *getIRoReg();
+
 	unsigned getDRLen();
 	unsigned getIRLen();
 
+	// a scan has completed (print and notify the handler)
+	void scanDone(bool ir);
+
+	// limit the number of register bits printed (0: no limit)
+	void setPrintBits(unsigned maxBits);
+	// default for contexts created subsequently (64)
+	static void setDefaultPrintBits(unsigned maxBits);
+
+	// 'h' may be 0; the handler is not owned by the context
+	void setScanHandler(JtagScanHandler *h);
+
+	// account for every TCK cycle in 'p' (may be 0; not owned by the
+	// context). A quiet context captures the registers while profiling.
+	void setProfile(JtagProfile *p);
+	JtagProfile *getProfile();
+
 	void changeState(JtagState *newState);	
 
+	JtagState *getState();
+
+	bool isQuiet();
+
+	// TAP in Test-Logic-Reset or Run-Test/Idle
+	bool isIdle();
+
+	// per-bit reference implementation
 	void advance(int tms, int tdo, int tdi);
 
+	// next state (index) after one TCK cycle
+	static unsigned nextState(unsigned idx, int tms);
+
 	void processBuf(int nbits, unsigned char *tmsb, unsigned char *tdob, unsigned char *tdib);
 };
 
@@ -15,49 +15,129 @@
 //-----------------------------------------------------------------------------
 
 #include <xvcConn.h>
+#include <xvcMetrics.h>
+#include <xvcRecorder.h>
 
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
 
-XvcConn::XvcConn( int sd, JtagDriver *drv, unsigned long maxVecLen )
+static XvcCounter   nGetinfo("xvc_getinfo_total",        "Number of 'getinfo:' commands");
+static XvcCounter   nSettck ("xvc_settck_total",         "Number of 'settck:' commands");
+static XvcCounter   nShift  ("xvc_shift_total",          "Number of 'shift:' commands");
+static XvcCounter   nBits   ("xvc_shift_bits_total",     "Number of bits shifted");
+static XvcHistogram hChunks ("xvc_shift_chunks",         "Number of driver chunks per shift");
+static XvcCounter   nMerged ("xvc_shift_merged_total",   "Number of 'shift:' commands merged into the driver shift of a preceding one");
+static XvcHistogram hRecv   ("xvc_tcp_recv_seconds",     "Time from the first to the last octet of a command (TCP)", 1.0E-9, 7);
+static XvcHistogram hFlush  ("xvc_tcp_flush_seconds",    "Time spent sending a reply to TCP",                        1.0E-9, 7);
+
+static uint64_t
+nowNs()
+{
+struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+XvcConn::XvcConn( int sd, JtagDriver *drv, unsigned long maxVecLen, JtagDumpCtx *tap, XvcPipeline *pipe, bool async, bool profile )
 : drv_       ( drv         ),
+  tap_       ( tap         ),
+  pipe_      ( pipe        ),
+  async_     ( async       ),
+  prof_      ( 0           ),
   maxVecLen_ ( maxVecLen   ),
-  supVecLen_ ( 0           )
+  tgtVecLen_ ( 0           ),
+  supVecLen_ ( 0           ),
+  state_     ( CMD         ),
+  t0_        ( 0           ),
+  pend_      ( 0           ),
+  nMrg_      ( 0           ),
+  mrgLen_    ( 0           )
 {
 socklen_t sz = sizeof(peer_);
+int       one;
 
 	// RAII for the sd_
-	if ( (sd_ = ::accept(sd, (struct sockaddr*)&peer_, &sz) ) < 0 ) {
+	if ( (sd_ = ::accept4(sd, (struct sockaddr*)&peer_, &sz, SOCK_NONBLOCK) ) < 0 ) {
 		throw SysErr("Unable to accept connection");
 	}
+
+	// XVC protocol is synchronous / not pipelined :-(
+	// use TCP_NODELAY to make sure our messages (many of which
+	// are small) are sent ASAP
+	one = 1;
+	if ( setsockopt( sd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one) ) ) {
+		::close( sd_ );
+		throw SysErr("Unable to set TCP_NODELAY");
+	}
+
+	// a client which vanishes (crash, cable) while it holds the driver
+	// must not starve others forever; let TCP find out. This is not
+	// essential, hence we ignore errors.
+	setsockopt( sd_, SOL_SOCKET,  SO_KEEPALIVE,  &one, sizeof(one) );
+	one = 10;
+	setsockopt( sd_, IPPROTO_TCP, TCP_KEEPIDLE,  &one, sizeof(one) );
+	one = 5;
+	setsockopt( sd_, IPPROTO_TCP, TCP_KEEPINTVL, &one, sizeof(one) );
+	one = 3;
+	setsockopt( sd_, IPPROTO_TCP, TCP_KEEPCNT,   &one, sizeof(one) );
+
+	try {
+		allocBufs();
+	} catch (...) {
+		::close( sd_ );
+		throw;
+	}
+
+	if ( profile && tap_ ) {
+		prof_ = new XvcProfile();
+	}
 }
 
 XvcConn::~XvcConn()
 {
 	::close( sd_ );
+	if ( prof_ ) {
+		if ( tap_->getProfile() == prof_ ) {
+			tap_->setProfile( 0 );
+		}
+		delete prof_;
+	}
 }
 
-// fill rx buffer to 'n' octets
+// read whatever is available
 void
-XvcConn::fill(unsigned long n)
+XvcConn::fill()
 {
-uint8_t      *p = rp_ + rl_;
+unsigned long avail;
 int           got;
-unsigned long k = n;
 
-	if ( n <= rl_ )
+	// make sure there is room for a complete command (which may be up
+	// to 'chunk_' octets). The buffer must not move during a shift;
+	// the driver may be working on it.
+	if ( CMD == state_ && rp_ + rl_ + chunk_ > &rxb_[0] + rxb_.size() ) {
+		memmove( &rxb_[0], rp_, rl_ );
+		rp_ = &rxb_[0];
+	}
+
+	avail = &rxb_[0] + rxb_.size() - (rp_ + rl_);
+	if ( 0 == avail ) {
 		return;
+	}
 
-	k -= rl_;
-	while ( k > 0 ) {
-		got = read( sd_, p, k );
-		if ( got <= 0 ) {
-			throw SysErr("Unable to read from socket");
+	got = read( sd_, rp_ + rl_, avail );
+	if ( got <= 0 ) {
+		if ( got < 0 && ( EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno ) ) {
+			return;
 		}
-		k -= got;
-		p += got;
+		throw SysErr("Unable to read from socket");
 	}
-	rl_ = n;
+
+	if ( 0 == rl_ && CMD == state_ ) {
+		// start of a new command
+		t0_ = nowNs();
+	}
+
+	rl_ += got;
 }
 
 // mark 'n' octets as 'consumed'
@@ -68,21 +148,24 @@ XvcConn::bump(unsigned long n)
 	rl_ -= n;
 	if ( rl_ == 0 ) {
 		rp_ = &rxb_[0];
+	} else {
+		// next command has (partially) arrived already
+		t0_ = nowNs();
 	}
 }
 
 void
-XvcConn::allocBufs()
+XvcConn::updVecLen()
 {
-unsigned long      tgtVecLen;
-unsigned long      overhead = 128; //headers and such;
-
-	// Determine the vector size supported by the target
-    tgtVecLen = drv_->query();
-
-	if ( 0 == tgtVecLen ) {
-		// target can stream
-		tgtVecLen = maxVecLen_;
+	if ( 0 == tgtVecLen_ ) {
+		// Determine the vector size supported by the target (not done
+		// by the constructor; other clients may be using the driver).
+		tgtVecLen_ = drv_->query();
+
+		if ( 0 == tgtVecLen_ ) {
+			// target can stream
+			tgtVecLen_ = maxVecLen_;
+		}
 	}
 
 	// What can the driver support?
@@ -90,10 +173,20 @@ unsigned long      overhead = 128; //headers and such;
 
 	if ( supVecLen_ == 0 ) {
 		// supports any size
-		supVecLen_ = tgtVecLen;
-	} else if ( tgtVecLen < supVecLen_ ) {
-		supVecLen_ = tgtVecLen;
+		supVecLen_ = tgtVecLen_;
+	} else if ( tgtVecLen_ < supVecLen_ ) {
+		supVecLen_ = tgtVecLen_;
 	}
+}
+
+void
+XvcConn::allocBufs()
+{
+unsigned long      overhead = 128; //headers and such;
+
+	// the target's vector size is determined (by 'updVecLen()') when
+	// the first shift is processed
+	tgtVecLen_ = 0;
 
 	chunk_  = (2*maxVecLen_ + overhead);
 
@@ -103,134 +196,467 @@ unsigned long      overhead = 128; //headers and such;
 	rp_     = &rxb_[0];
 	rl_     = 0;
 	tl_     = 0;
+	txOff_  = 0;
 }
 
-void
+bool
 XvcConn::flush()
 {
 int      put;
-uint8_t *p = &txb_[0];
 
-	while ( tl_ > 0 ) {
-		put = write( sd_, p, tl_ );
+	if ( txOff_ == tl_ )
+		return true;
+
+XvcTimed  tim( &hFlush );
+
+	while ( txOff_ < tl_ ) {
+		put = send( sd_, &txb_[0] + txOff_, tl_ - txOff_, MSG_NOSIGNAL );
 		if ( put <= 0 ) {
+			if ( put < 0 && ( EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno ) ) {
+				return false;
+			}
 			throw SysErr("Unable to send from socket");
 		}
-		p   += put;
-		tl_ -= put;
+		txOff_ += put;
 	}
+	return true;
+}
+
+bool
+XvcConn::busy()
+{
+	return CMD != state_;
+}
+
+bool
+XvcConn::wantRead()
+{
+	if ( busy() ) {
+		// the buffer does not move during a shift
+		return rp_ + rl_ < &rxb_[0] + rxb_.size();
+	}
+	// don't read (and buffer) more while the client doesn't take our replies;
+	// apply back-pressure instead
+	return txOff_ == tl_;
+}
+
+bool
+XvcConn::wantWrite()
+{
+	return txOff_ < tl_;
 }
 
 void
-XvcConn::run()
+XvcConn::onReadable()
 {
+	fill();
+}
 
-int        got;
-uint32_t   bits, bitsLeft, bitsSent;
-unsigned long bytes;
-unsigned long vecLen;
-unsigned long off;
+void
+XvcConn::onWritable()
+{
+	flush();
+}
 
+void
+XvcConn::process()
+{
+	while ( SHIFT == state_ ? shiftStep() : cmdStep() )
+		;
+}
 
-	allocBufs();
+// returns true if a command was executed
+bool
+XvcConn::cmdStep()
+{
+uint32_t       bits;
+int            i;
+XvcRecorder   *rec = XvcRecorder::get();
 
-	// XVC protocol is synchronous / not pipelined :-(
-	// use TCP_NODELAY to make sure our messages (many of which
-	// are small) are sent ASAP
-	got = 1;
-	if ( setsockopt( sd_, IPPROTO_TCP, TCP_NODELAY, &got, sizeof(got) ) ) {
-		throw SysErr("Unable to set TCP_NODELAY");
+	// a new command may only start once the previous reply has been sent
+	if ( rl_ < 2 || ! flush() ) {
+		return false;
 	}
 
-	while ( 1 ) {
+	txOff_ = tl_ = 0;
 
-	// read stuff;
+	if ( 0 == ::memcmp( rp_, "ge", 2 ) ) {
+		if ( rl_ < 8 ) {
+			return false;
+		}
 
-	got = read( sd_, rp_, chunk_ );
-	if ( got <= 0 ) {
-		throw SysErr("Unable to read from socket");
-	}
+		hRecv.observe( nowNs() - t0_ );
 
-	rl_ = got;
+		nGetinfo.inc();
 
-	do {
+		tgtVecLen_ = drv_->query(); // informs the driver that there is a new connection
+		if ( 0 == tgtVecLen_ ) {
+			tgtVecLen_ = maxVecLen_;
+		}
 
-		fill( 2 );
+		tl_ = sprintf( (char*)&txb_[0], "xvcServer_v1.0:%ld\n", maxVecLen_ );
 
-		if ( 0 == ::memcmp( rp_, "ge", 2 ) ) {
-			fill( 8 );
+		if ( rec ) {
+			rec->record( XvcRecorder::XVC_CMD, t0_, rp_, 8 );
+			rec->record( XvcRecorder::XVC_REP, XvcRecorder::now(), &txb_[0], tl_ );
+		}
 
-			drv_->query(); // informs the driver that there is a new connection
+		bump( 8 );
+	} else
+	if ( 0 == ::memcmp( rp_, "se", 2 ) ) {
+		uint32_t requestedPeriod;
+		uint32_t newPeriod;
 
-			tl_ = sprintf( (char*)&txb_[0], "xvcServer_v1.0:%ld\n", maxVecLen_ );
+		if ( rl_ < 11 ) {
+			return false;
+		}
 
-			bump( 8 );
-		} else
-		if ( 0 == ::memcmp( rp_, "se", 2 ) ) {
-			uint32_t requestedPeriod;
-			uint32_t newPeriod;
+		hRecv.observe( nowNs() - t0_ );
 
-			fill( 11 );
+		nSettck.inc();
 
-			requestedPeriod = (rp_[10] << 24) | (rp_[9] << 16) | (rp_[8] << 8) | rp_[7];
+		requestedPeriod = (rp_[10] << 24) | (rp_[9] << 16) | (rp_[8] << 8) | rp_[7];
 
-			newPeriod = drv_->setPeriodNs( requestedPeriod );
+		newPeriod = drv_->setPeriodNs( requestedPeriod );
 
-			for ( unsigned u = 0; u < sizeof(newPeriod); u++ ) {
-				txb_[u]   = (uint8_t)newPeriod;
-				newPeriod = newPeriod >> 8;
-			}
+		for ( unsigned u = 0; u < sizeof(newPeriod); u++ ) {
+			txb_[u]   = (uint8_t)newPeriod;
+			newPeriod = newPeriod >> 8;
+		}
+
+		tl_ = 4;
+
+		if ( rec ) {
+			rec->record( XvcRecorder::XVC_CMD, t0_, rp_, 11 );
+			rec->record( XvcRecorder::XVC_REP, XvcRecorder::now(), &txb_[0], tl_ );
+		}
+
+		bump( 11 );
+	} else
+	if ( 0 == ::memcmp( rp_, "sh", 2 ) ) {
+		if ( rl_ < 10 ) {
+			return false;
+		}
+
+		bits = 0;
+		for ( i = 9; i >=6; i-- ) {
+			bits = (bits<<8) | rp_[i];
+		}
+		bytes_ = (bits + 7)/8;
+		if ( bytes_ > maxVecLen_ ) {
+			throw ProtoErr("Requested bit vector length too big");
+		}
+
+		// the TMS vector must be complete before we can start
+		if ( rl_ < 10 + bytes_ ) {
+			return false;
+		}
 
-			tl_ = 4;
+		nShift.inc();
+		nBits.inc( bits );
 
-			bump( 11 );
-		} else
-		if ( 0 == ::memcmp( rp_, "sh", 2 ) ) {
-			fill( 10 );
+		updVecLen();
 
-			bits = 0;
-			for ( got = 9; got >=6; got-- ) {
-				bits = (bits<<8) | rp_[got];
+		bits_   = bits;
+
+		if ( coalesce() ) {
+			// the merged vectors are our own
+			tms_ = &mrg_[0];
+			tdi_ = tms_ + bytes_;
+			tdo_ = tdi_ + bytes_;
+		}
+
+		vecLen_ = bytes_ > supVecLen_ ? supVecLen_ : bytes_;
+
+		hChunks.observe( vecLen_ ? (bytes_ + vecLen_ - 1)/vecLen_ : 0 );
+
+		maxPend_  = drv_->getMaxInFlight();
+		bitsLeft_ = bits_;
+		off_      = 0;
+		cmp_      = 0;
+		pend_     = 0;
+
+		// the header stays in the buffer until the command is done and the
+		// buffer must not move in the meantime; make room for the entire
+		// command now.
+		if ( 0 == nMrg_ ) {
+			if ( rp_ + 10 + 2*bytes_ > &rxb_[0] + rxb_.size() ) {
+				memmove( &rxb_[0], rp_, rl_ );
+				rp_ = &rxb_[0];
 			}
-			bytes = (bits + 7)/8;
-			if ( bytes > maxVecLen_ ) {
-				throw ProtoErr("Requested bit vector length too big");
+			tms_ = rp_ + 10;
+			tdi_ = tms_ + bytes_;
+			tdo_ = &txb_[0];
+		}
+		state_    = SHIFT;
+	} else {
+		throw ProtoErr("unsupported message received");
+	}
+
+	flush();
+
+	return true;
+}
+
+void
+XvcConn::completeChunk()
+{
+	drv_->completeVectors();
+	chunkDone();
+}
+
+void
+XvcConn::chunkDone()
+{
+unsigned long l;
+
+	pend_--;
+	l     = bytes_ - cmp_ > vecLen_ ? vecLen_ : bytes_ - cmp_;
+	cmp_ += l;
+	if ( 0 == nMrg_ ) {
+		// merged shifts are replied to once they are done
+		tl_   = cmp_;
+		flush();
+	}
+}
+
+// OR the 'n' (if less than 8) low bits of 'v' into 'd' at bit offset 'o'
+static void
+bitIns(uint8_t *d, unsigned long o, uint8_t v, unsigned long n)
+{
+unsigned s = o % 8;
+
+	if ( n < 8 ) {
+		v &= (1 << n) - 1;
+	}
+	d[o/8] |= v << s;
+	if ( s && n + s > 8 ) {
+		d[o/8 + 1] |= v >> (8 - s);
+	}
+}
+
+// XVC clients usually send a number of (small) shifts without waiting
+// for the replies. Those which are already buffered completely may be
+// executed by a single driver shift (i.e., a single round-trip to the
+// firmware) - JTAG doesn't care where one command ends and the next one
+// starts. The vectors are bit-packed, i.e., not padded to octets.
+bool
+XvcConn::coalesce()
+{
+uint8_t       *p    = rp_;
+uint8_t       *end  = rp_ + rl_;
+unsigned long  tot  = 0;
+unsigned long  rep  = 0;
+unsigned long  nbytes, totBytes, i, o;
+uint32_t       bits;
+unsigned       n    = 0;
+int            k;
+
+	nMrg_ = 0;
+
+	while ( p + 10 <= end && 0 == ::memcmp( p, "sh", 2 ) ) {
+		bits = 0;
+		for ( k = 9; k >= 6; k-- ) {
+			bits = (bits<<8) | p[k];
+		}
+		nbytes = (bits + 7)/8;
+		// must be complete and fit into a single chunk and the
+		// reply buffer
+		if (    0 == bits
+		     || p + 10 + 2*nbytes > end
+		     || tot + bits        > 8*supVecLen_
+		     || rep + nbytes      > maxVecLen_ ) {
+			break;
+		}
+		tot += bits;
+		rep += nbytes;
+		p   += 10 + 2*nbytes;
+		n++;
+	}
+
+	if ( n < 2 ) {
+		return false;
+	}
+
+	totBytes = (tot + 7)/8;
+
+	// TMS, TDI and TDO (+1 so the last octet can be read unconditionally
+	// when splitting)
+	mrg_.assign( 3*totBytes + 1, 0 );
+
+	for ( p = rp_, o = 0, k = 0; k < (int)n; k++, p += 10 + 2*nbytes ) {
+		bits   = p[6] | (p[7]<<8) | (p[8]<<16) | (p[9]<<24);
+		nbytes = (bits + 7)/8;
+		for ( i = 0; i < nbytes; i++ ) {
+			bitIns( &mrg_[0],            o, p[10 + i],          bits - 8*i );
+			bitIns( &mrg_[0] + totBytes, o, p[10 + nbytes + i], bits - 8*i );
+			o += bits - 8*i > 8 ? 8 : bits - 8*i;
+		}
+	}
+
+	nShift.inc( n - 1 );
+	nBits.inc( tot - bits_ );
+	nMerged.inc( n - 1 );
+
+	nMrg_   = n;
+	mrgLen_ = p - rp_;
+	bits_   = tot;
+	bytes_  = totBytes;
+
+	return true;
+}
+
+void
+XvcConn::splitReplies()
+{
+uint8_t       *p, *d;
+unsigned long  nbytes, i, o;
+uint32_t       bits;
+unsigned       n, s;
+
+	tl_ = 0;
+	for ( p = rp_, o = 0, n = 0; n < nMrg_; n++, p += 10 + 2*nbytes ) {
+		bits   = p[6] | (p[7]<<8) | (p[8]<<16) | (p[9]<<24);
+		nbytes = (bits + 7)/8;
+		d      = &txb_[0] + tl_;
+		s      = o % 8;
+		for ( i = 0; i < nbytes; i++ ) {
+			d[i] = tdo_[o/8 + i] >> s;
+			if ( s ) {
+				d[i] |= tdo_[o/8 + i + 1] << (8 - s);
 			}
-			bump( 10 );
-			fill( 2*bytes );
+		}
+		if ( bits % 8 ) {
+			d[nbytes - 1] &= (1 << (bits % 8)) - 1;
+		}
+		shiftDone( p, bits, d );
+		o   += bits;
+		tl_ += nbytes;
+	}
+	nMrg_ = 0;
+}
+
+void
+XvcConn::shiftDone(uint8_t *cmd, uint32_t bits, uint8_t *tdo)
+{
+unsigned long nbytes = (bits + 7)/8;
+XvcRecorder  *rec;
 
-			vecLen = bytes > supVecLen_ ? supVecLen_ : bytes;
+	if ( tap_ ) {
+		// the tracker is shared by all connections of the server
+		tap_->setProfile( prof_ );
+		tap_->processBuf( bits, cmd + 10, cmd + 10 + nbytes, cmd + 10 + nbytes );
+	}
 
-			// break into chunks the driver can handle; due to the xvc layout we can't efficiently
-			// start working on a chunk while still waiting for more data to come in (well - we could
-			// but had to have the full TDI vector plus a chunk of the TMS vector in. Thus, we don't
-			// bother...).
-			for ( off = 0, bitsLeft = bits; bitsLeft > 0; bitsLeft -= bitsSent, off += vecLen ) {
+	if ( prof_ ) {
+		prof_->message( bits );
+	}
 
-				bitsSent = 8*vecLen;
-				if ( bitsLeft < bitsSent ) {
-					bitsSent = bitsLeft;
-				}
+	if ( (rec = XvcRecorder::get()) ) {
+		rec->record( XvcRecorder::XVC_CMD, t0_, cmd, 10 + 2*nbytes );
+		rec->record( XvcRecorder::XVC_REP, XvcRecorder::now(), tdo, nbytes );
+	}
+}
+
+// break into chunks the driver can handle. Since XVC sends the entire TMS vector
+// ahead of the TDI vector we can dispatch a chunk as soon as its TDI bytes have
+// arrived and send the TDO back right away; thus network reception, the firmware
+// transfer and the TDO reply all overlap. The driver may keep up to 'maxPend_'
+// chunks in flight.
+//
+// Returns true when the command is done.
+bool
+XvcConn::shiftStep()
+{
+uint32_t      bitsSent;
+
+	if ( async_ ) {
+		// collect what the driver has completed meanwhile
+		while ( pend_ > 0 && drv_->pollVectors() ) {
+			chunkDone();
+		}
+	}
+
+	while ( bitsLeft_ > 0 ) {
+
+		bitsSent = 8*vecLen_;
+		if ( bitsLeft_ < bitsSent ) {
+			bitsSent = bitsLeft_;
+		}
 
-				drv_->sendVectors( bitsSent, rp_ + off, rp_ + bytes + off, &txb_[0] + off );
+		if ( 0 == nMrg_ && rl_ < 10 + bytes_ + off_ + (bitsSent + 7)/8 ) {
+			// Starved; must wait for more TDI data. Don't leave anything in
+			// flight while we are waiting for the client (the driver
+			// thread or - in async mode - the server takes care of that).
+			if ( ! pipe_ ) {
+				drv_->flushVectors();
+				while ( ! async_ && pend_ > 0 ) {
+					completeChunk();
+				}
 			}
-			tl_ = bytes;
+			return false;
+		}
+
+		if ( async_ && pend_ >= maxPend_ ) {
+			// resume when the driver is ready
+			return false;
+		}
+
+		if ( pipe_ ) {
+			XvcJob j;
 
-			bump( 2*bytes );
+			if ( pipe_->full() ) {
+				// resume when chunks complete
+				return false;
+			}
+			j.bits_   = bitsSent;
+			j.tms_    = tms_ + off_;
+			j.tdi_    = tdi_ + off_;
+			j.tdo_    = tdo_ + off_;
+			j.first_  = ( 0 == off_ );
+			j.last_   = ( bitsLeft_ == bitsSent );
+			j.failed_ = false;
+			pipe_->submit( j );
 		} else {
-			throw ProtoErr("unsupported message received");
+			drv_->submitVectors( bitsSent, tms_ + off_, tdi_ + off_, tdo_ + off_ );
 		}
+		pend_++;
+		bitsLeft_ -= bitsSent;
+		off_      += vecLen_;
 
-		flush();
+		if ( 0 == bitsLeft_ ) {
+			hRecv.observe( nowNs() - t0_ );
+		}
+
+		// reply with the oldest chunk(s) once the pipeline is full or
+		// everything has been submitted
+		while ( ! pipe_ && pend_ > 0 && ( pend_ >= maxPend_ || 0 == bitsLeft_ ) ) {
+			if ( ! async_ ) {
+				completeChunk();
+			} else if ( drv_->pollVectors() ) {
+				chunkDone();
+			} else {
+				break;
+			}
+		}
+	}
 
-		/* Repeat until all the characters from the first chunk are exhausted
-		 * (most likely the chunk just contained a vector shift message) and
-		 * it is exhausted during the first iteration. If for some reason it is
-		 * not then we use the spill-over area for a second iteration which
-		 * should then terminate this while loop.
-		 */
-	} while ( rl_ > 0 );
+	if ( pend_ > 0 ) {
+		// waiting for the driver (thread)
+		return false;
+	}
 
+	state_ = CMD;
+
+	if ( nMrg_ ) {
+		// all the replies go out together
+		splitReplies();
+		bump( mrgLen_ );
+		flush();
+	} else {
+		shiftDone( rp_, bits_, &txb_[0] );
+		bump( 10 + 2*bytes_ );
 	}
 
+	return true;
 }
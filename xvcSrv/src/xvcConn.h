@@ -18,14 +18,34 @@
 #define XVC_CONNECTION_H
 
 #include <xvcSrv.h>
+#include <jtagDump.h>
+#include <xvcPipeline.h>
+#include <xvcProfile.h>
 
 #include <sys/socket.h>
 #include <netinet/in.h>
 
 // Class managing a XVC tcp connection
+//
+// The connection is driven by events: the socket is non-blocking and
+// the protocol parser is a state machine which resumes wherever the
+// input ran out (e.g., in the middle of the TDI vector of a 'shift:'
+// command). The server calls 'onReadable()'/'onWritable()' when the
+// socket is ready; thus, a single thread may service many connections
+// and a slow (or dead) client never blocks the driver.
+//
+// Reading/writing the socket and processing the input are separate so
+// that the server may buffer the input of a connection which currently
+// must not use the driver.
 
 class XvcConn {
+	typedef enum { CMD, SHIFT } State;
+
 	JtagDriver        *drv_;
+	JtagDumpCtx       *tap_;
+	XvcPipeline       *pipe_;
+	bool               async_;
+	XvcProfile        *prof_;
 	int                sd_;
 	struct sockaddr_in peer_;
 	// just use vectors to back raw memory; DONT use 'size/resize'
@@ -35,20 +55,73 @@ class XvcConn {
 	uint8_t           *rp_;
     unsigned long      rl_;
 	unsigned long      tl_;
+	unsigned long      txOff_;
 
 	vector<uint8_t>    txb_;
 	unsigned long      maxVecLen_;
+	unsigned long      tgtVecLen_;
 	unsigned long      supVecLen_;
 	unsigned long      chunk_;
 
+	// parser state
+	State              state_;
+	uint64_t           t0_;
+	uint32_t           bits_;
+	uint32_t           bitsLeft_;
+	unsigned long      bytes_;
+	unsigned long      vecLen_;
+	unsigned long      off_;
+	unsigned long      cmp_;
+	unsigned           pend_;
+	unsigned           maxPend_;
+	// vectors of the current shift
+	uint8_t           *tms_;
+	uint8_t           *tdi_;
+	uint8_t           *tdo_;
+	// number of 'shift:' commands merged into the current shift (0 if
+	// it is a single one), the input they occupy and their vectors
+	unsigned           nMrg_;
+	unsigned long      mrgLen_;
+	vector<uint8_t>    mrg_;
+
+	// execute the next command if it is complete
+	virtual bool cmdStep();
+
+	// make progress with a 'shift:' command; returns true when done
+	virtual bool shiftStep();
+
+	// complete the oldest chunk in flight and queue its TDO
+	virtual void completeChunk();
+
+	// merge the 'shift:' commands which are buffered (completely) back
+	// to back into a single shift (up to the chunk size); returns false
+	// if there is nothing to merge
+	virtual bool coalesce();
+
+	// split the TDO of merged shifts into the replies
+	virtual void splitReplies();
+
+	// bookkeeping once a 'shift:' command is done
+	virtual void shiftDone(uint8_t *cmd, uint32_t bits, uint8_t *tdo);
+
 public:
-XvcConn( int sd, JtagDriver *drv, unsigned long maxVecLen_ = 32768 );
+	// the TMS of every shift is fed into 'tap' (if non-NULL) which
+	// thus tracks the state of the target's TAP. If 'pipe' is non-NULL
+	// then the chunks of a shift are executed by its driver thread.
+	// If 'async' is true then chunks are completed with the driver's
+	// 'pollVectors()' and the connection never waits for the target;
+	// the server calls 'process()' when the driver is ready.
+	// If 'profile' is true then the traffic is profiled (requires 'tap').
+	XvcConn( int sd, JtagDriver *drv, unsigned long maxVecLen_ = 32768, JtagDumpCtx *tap = 0, XvcPipeline *pipe = 0, bool async = false, bool profile = false );
 
-	// fill rx buffer to 'n' octets (from TCP connection)
-	virtual void fill(unsigned long n);
+	virtual int  getSd() { return sd_; }
 
-	// send tx buffer to TCP connection
-	virtual void flush();
+	// read what is available from the TCP connection (without blocking)
+	virtual void fill();
+
+	// send as much of the pending reply as the TCP connection takes
+	// (without blocking); returns true if everything has been sent.
+	virtual bool flush();
 
 	// discard 'n' octets from rx buffer (mark as consumed)
 	virtual void bump(unsigned long n);
@@ -56,7 +129,33 @@ XvcConn( int sd, JtagDriver *drv, unsigned long maxVecLen_ = 32768 );
 	// (re)allocated buffers
 	virtual void allocBufs();
 
-	virtual void run();
+	// (re)compute the chunk size supported by target and driver;
+	// the driver's limit may change at run-time (e.g., path MTU)
+	virtual void updVecLen();
+
+	// process buffered input as far as possible (uses the driver)
+	virtual void process();
+
+	// event handlers (only do I/O; the driver is not used);
+	// throw SysErr if the connection should be closed
+	virtual void onReadable();
+	virtual void onWritable();
+
+	// what events the connection is interested in
+	virtual bool wantRead();
+	virtual bool wantWrite();
+
+	// true while a command is only partially processed
+	virtual bool busy();
+
+	// a chunk submitted to the pipeline has been completed
+	virtual void chunkDone();
+
+	// are chunks in flight (async mode: waiting for the driver)?
+	virtual bool pending() { return pend_ > 0; }
+
+	// NULL unless profiling
+	virtual XvcProfile *getProfile() { return prof_; }
 
 	virtual ~XvcConn();
 };
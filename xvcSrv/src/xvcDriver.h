@@ -26,10 +26,11 @@
 #include <unistd.h>
 #include <vector>
 #include <string>
+#include <xvcInterleave.h>
 
 using std::vector;
 
-class JtagDumpCtx;
+class XvcSniffer;
 
 // Abstract JTAG driver -- in most cases you'd want to
 // subclass JtagDriverAxisToJtag if you want to support
@@ -40,7 +41,10 @@ protected:
 	// occasionally drop a packet for testing (when enabled)
 	unsigned     drop_;
 	bool         drEn_;
-	JtagDumpCtx *snif_;
+	// (loopback emulation) occasionally forget the macros for testing
+	bool         mfEn_;
+	// decodes the traffic in the background (-s); created on demand
+	XvcSniffer  *snif_;
 
 public:
 	JtagDriver(int argc, char *const argv[], unsigned debug);
@@ -64,6 +68,16 @@ public:
 	query()
 		= 0;
 
+	// The target's parameters rarely change; 'query()' may answer from
+	// a cache for up to 'ms' milliseconds (0: always ask the target). The
+	// default implementation ignores this.
+	virtual void
+	setQueryTtl(unsigned ms);
+
+	// forget the cached parameters; the next 'query()' asks the target
+	virtual void
+	resetQuery();
+
 	// Max. vector size (in bytes) this driver supports - may be different
 	// from what the target supports and the minimum will be used...
 	// Note that this is a single vector (the message the driver
@@ -89,6 +103,59 @@ public:
 		uint8_t          *tdo)
 		= 0;
 
+	// Pipelined variant of 'sendVectors()'; the driver may merely
+	// transmit the vectors and return. The TDO vector of a submitted
+	// chunk is only valid once the matching 'completeVectors()' has
+	// returned (chunks complete in the order they were submitted).
+	// The caller must never have more than 'getMaxInFlight()' chunks
+	// outstanding. The default implementation is synchronous.
+	virtual void
+	submitVectors(
+		unsigned long numBits,
+		uint8_t          *tms,
+		uint8_t          *tdi,
+		uint8_t          *tdo);
+
+	// a driver may hold back submitted chunks in order to transmit them
+	// in a batch; this pushes them out. Must be called before the caller
+	// blocks (e.g., waiting for more vectors to arrive).
+	virtual void
+	flushVectors();
+
+	// wait for the oldest submitted chunk to complete (implies 'flushVectors()')
+	virtual void
+	completeVectors();
+
+	// max. number of chunks that may be outstanding
+	virtual unsigned
+	getMaxInFlight();
+
+	// Event-driven completion (for callers running an event loop): the
+	// caller announces that it is going to use 'pollVectors()' instead of
+	// 'completeVectors()'. Returns a descriptor which becomes readable when
+	// 'pollVectors()' may make progress or -1 if the driver can only block
+	// (the default; 'pollVectors()' then still works but blocks).
+	virtual int
+	asyncVectors();
+
+	// never blocks (unless 'asyncVectors()' returned -1): transmits held
+	// back chunks, consumes the replies which have arrived and retransmits
+	// if the target did not answer in time. Returns true once the oldest
+	// submitted chunk is complete (it is then retired as if by
+	// 'completeVectors()'); errors are reported like 'completeVectors()'.
+	virtual bool
+	pollVectors();
+
+	// ms until 'pollVectors()' must be called even if the descriptor
+	// does not become readable (-1: no deadline)
+	virtual int
+	getPollTimeout();
+
+	// forget all chunks in flight (e.g., because the connection they
+	// belong to is gone); their TDO is not written anymore.
+	virtual void
+	abortVectors();
+
 	virtual void
 	dumpInfo(FILE *f = stdout) = 0;
 
@@ -122,7 +189,13 @@ private:
 		bool         needTargetArg_;
 	} RegEntry;
 
+	typedef struct {
+		std::string  path_;
+		const char * name_;
+	} Loaded;
+
 	vector<RegEntry> entries_;
+	vector<Loaded>   loaded_;
 
 	 DriverRegistry();
 	~DriverRegistry();
@@ -142,6 +215,11 @@ public:
 
 	bool has(const char *drvnam);
 
+	// make sure driver 'drvnam' is available (by loading the shared
+	// object 'drvnam' unless it is built-in); returns the name under
+	// which the driver is registered.
+	const char *load(const char *drvnam);
+
 	static DriverRegistry *
 	get();
 
@@ -184,6 +262,12 @@ public:
 	ProtoErr(const char *msg);
 };
 
+// The target does not hold a macro we referenced (e.g., it was reloaded)
+class NoMacroErr : public ProtoErr {
+public:
+	NoMacroErr(const char *msg);
+};
+
 // Timeout
 class TimeoutErr : public std::runtime_error {
 public:
@@ -225,6 +309,15 @@ public:
 //
 // If a timeout occurs then 'xfer' must throw a TimeoutErr().
 //
+// A driver which can have several messages in flight may additionally
+// implement the split-phase primitives 'xmit()' and 'recv()' and
+// announce the depth of its pipeline with 'setMaxInFlight()'. Replies
+// are then matched to outstanding messages by transaction ID.
+//
+// If the driver also implements 'getRxFd()', 'tryRecvv()' and
+// 'getRxTimeout()' then it supports event-driven completion (see
+// 'JtagDriver::asyncVectors()').
+//
 class JtagDriverAxisToJtag : public JtagDriver {
 protected:
 	typedef uint32_t Header;
@@ -233,8 +326,50 @@ protected:
 	static const Xid XID_ANY = 0;
 
 private:
+	// transaction in flight
+	typedef struct {
+		vector<uint8_t> msg_;
+		unsigned        len_;
+		Xid             xid_;
+		unsigned long   bits_;
+		uint8_t        *tms_;
+		uint8_t        *tdi_;
+		uint8_t        *tdo_;
+		unsigned        tdoBytes_;
+		bool            done_;
+	} Xact;
+
 	unsigned        wordSize_;
 	unsigned        memDepth_;
+	// protocol version negotiated by 'query()'
+	Header          vers_;
+	// the target rejected a PVER1 query; don't try again
+	bool            noPver1_;
+	// capabilities (PVER1)
+	uint32_t        caps_;
+	// when 'query()' last asked the target (XvcRecorder::now()) and
+	// for how long (ns) the result remains valid
+	uint64_t        queryAt_;
+	uint64_t        queryTtl_;
+	bool            queryOk_;
+
+	// TMS/TDI macros (PVER1): what the target's slots hold
+	typedef struct {
+		unsigned long   bits_;
+		// TMS followed by TDI; bits past the end are cleared
+		vector<uint8_t> pat_;
+		// LRU stamp; 0 if the slot is empty
+		unsigned long   used_;
+	} Macro;
+
+	vector<Macro>    macros_;
+	unsigned long    macroStamp_;
+	// max. number of TMS/TDI word pairs of a macro
+	unsigned         macroPairs_;
+	vector<uint8_t>  macroKey_;
+	// hashes of recently seen patterns; a pattern is only
+	// defined as a macro when it shows up again
+	vector<uint32_t> macroSeen_;
 
 	vector<uint8_t> txBuf_;
 	vector<uint8_t> hdBuf_;
@@ -246,10 +381,84 @@ private:
 
 	uint32_t        periodNs_;
 
+	JtagInterleaver::Kernel ilv_;
+	const char             *ilvName_;
+
+	vector<Xact>    win_;
+	unsigned        winHd_;
+	unsigned        winCnt_;
+	// submitted but not transmitted yet (at the tail of the window)
+	unsigned        winQd_;
+	// bounce buffers for replies (one per window slot)
+	vector<uint8_t> rxBuf_;
+	unsigned        rxStride_;
+	vector<uint8_t> hdBufs_;
+	// argument vectors for xmitv/recvv
+	vector<uint8_t*> txv_;
+	vector<unsigned> txl_;
+	vector<uint8_t*> hdv_;
+	vector<uint8_t*> rxv_;
+	vector<unsigned> rxs_;
+	vector<int>      rxg_;
+	unsigned        maxInFlight_;
+	// retransmissions of the oldest transaction in flight
+	unsigned        attempt_;
+	// completion by 'pollVectors()'
+	bool            async_;
+
 	Header newXid();
 
-	Header   mkQuery();
-	Header   mkShift(unsigned len);
+	Header   mkQuery(Header vers);
+	Header   mkShift(unsigned len, Header vers);
+	Header   mkXCmd(Header op, unsigned len);
+
+	// format a shift message into 'buf'; returns the message size
+	unsigned mkShiftMsg(uint8_t *buf, unsigned long bits, uint8_t *tms, uint8_t *tdi);
+
+	// run-length encode the TMS/TDI word pairs of a PVER1 shift into 'buf'
+	// (past the header; nothing is stored if 'buf' is NULL). Encoding stops
+	// before the message would exceed 'maxBytes' and '*bits' is clipped
+	// to what has been encoded (whole words). RETURNS: the message size
+	unsigned mkRleMsg(uint8_t *buf, unsigned long *bits, uint8_t *tms, uint8_t *tdi, unsigned maxBytes);
+
+	static unsigned rleClass(uint8_t *p, unsigned l);
+
+	// is TMS low for all 'bits' but (maybe) the last one ('*lastTms')?
+	static bool     tmsIdle(uint8_t *tms, unsigned long bits, bool *lastTms);
+
+	// look a (short) shift up in the macro cache. RETURNS: the slot
+	// holding it ('*hit' is set), the slot it should be defined in or
+	// -1 if it is not worth a macro (yet).
+	int      findMacro(unsigned long bits, uint8_t *tms, uint8_t *tdi, bool *hit);
+
+	// forget all macros; we can no longer be sure what the target holds
+	void     flushMacros();
+
+	// debug output and sniffing once a shift has completed
+	void     postShift(unsigned long bits, uint8_t *tms, uint8_t *tdi, uint8_t *tdo);
+
+	// receive reply(ies) and match to the transactions in flight;
+	// if 'wait' is false then only what has arrived already is
+	// consumed. RETURNS: number of replies received.
+	unsigned recvReply(bool wait);
+
+	// oldest transaction in flight is done
+	void     retire();
+
+	// count a timeout; retransmit or throw if too many attempts failed
+	void     retry();
+
+	// transmit the messages of the transactions starting at
+	// window index 'from'
+	void     xmitWin(unsigned from);
+
+	// throw a ProtoErr if 'hdr' flags an error
+	void     chkErr(Header hdr);
+
+	// the target lost the macro referenced by the newest transaction in
+	// flight ('hdr' flags ERR_NO_MACRO); send its vectors again if that
+	// is safe. RETURNS: true if they were resent
+	bool     redoMacro(Header hdr);
 
 protected:
 
@@ -262,10 +471,15 @@ protected:
 
 
 	static const Header   PVER0 = 0x00000000;
-	static const Header   PVERS = PVER0;
+	// PVER0 plus run-length encoded shift vectors
+	static const Header   PVER1 = 0x40000000;
+	// the most recent version we speak
+	static const Header   PVERS = PVER1;
 	static const Header   CMD_Q = 0x00000000;
 	static const Header   CMD_S = 0x10000000;
 	static const Header   CMD_E = 0x20000000;
+	// PVER1 only
+	static const Header   CMD_X = 0x30000000;
 
 	static const Header   VRS_MASK  = 0xc0000000;
 	static const Header   CMD_MASK  = 0x30000000;
@@ -280,9 +494,70 @@ protected:
     static const unsigned ERR_BAD_COMMAND = 2;
     static const unsigned ERR_TRUNCATED   = 3;
     static const unsigned ERR_NOT_PRESENT = 4;
+    static const unsigned ERR_NO_MACRO    = 5;
+
+	// PVER1 shift payload: a sequence of records, each a control word
+	// followed by the literal words of a run of TMS/TDI word pairs
+	//   [ 1: 0] TMS: RLE_LIT (one word per pair), RLE_ZEROS or RLE_ONES
+	//   [ 3: 2] TDI: ditto
+	//   [23: 4] number of pairs in the run minus 1
+	static const unsigned      RLE_LIT       = 0;
+	static const unsigned      RLE_ZEROS     = 1;
+	static const unsigned      RLE_ONES      = 2;
+	static const unsigned      RLE_MODE_MASK = 3;
+	static const unsigned      RLE_TDI_SHIFT = 2;
+	static const unsigned      RLE_CNT_SHIFT = 4;
+	static const unsigned long RLE_MAX_RUN   = 1UL << 20;
+
+	// PVER1 extended command
+	//   [27:20] XID
+	//   [19:18] opcode
+	//   [17: 0] length (bits) minus 1
+	static const Header   X_OP_MASK     = 0x000c0000;
+	static const Header   X_LEN_MASK    = 0x0003ffff;
+	// TDI only; TMS is low
+	static const Header   X_OP_TDI      = 0x00000000;
+	// TDI only; TMS is low but raised on the last bit
+	static const Header   X_OP_TDI_EXIT = 0x00040000;
+	// macros; the length is reduced to [11:0] and [17:12] select the slot
+	// store the TMS/TDI pairs of the payload in a slot, then shift them
+	static const Header   X_OP_DEFINE   = 0x00080000;
+	// shift the pairs stored in a slot; there is no payload
+	static const Header   X_OP_MACRO    = 0x000c0000;
+	static const unsigned X_SLOT_SHIFT  = 12;
+	static const Header   X_SLOT_MASK   = 0x0003f000;
+	static const Header   X_MLEN_MASK   = 0x00000fff;
+
+	// capability flags; payload of the reply to a PVER1 query
+	static const uint32_t CAP_TDI_SHIFT = 0x00000001;
+	// [15: 8] number of macro slots, [23:16] max. word pairs per macro
+	static const unsigned CAP_SLOTS_SHIFT = 8;
+	static const unsigned CAP_PAIRS_SHIFT = 16;
+	// [31:24] max. length of a shift in units of CAP_VLEN_UNIT words if
+	// the memory depth does not limit PVER1 (0: it does)
+	static const uint32_t CAP_VLEN_MASK   = 0xff000000;
+	static const unsigned CAP_VLEN_SHIFT  = 24;
+	static const unsigned CAP_VLEN_UNIT   = 16;
+
+	// negotiated protocol version and capabilities
+	virtual Header        getProtoVers();
+	virtual uint32_t      getCaps();
+
+	// max. vector size (bytes) the target accepts (0: no limit)
+	virtual unsigned long getTgtVecSize();
+
+	// shifts are executed one at a time by 'sendVectors()'
+	virtual bool          syncVectors();
+
+	// how many of 'bits' (a multiple of 8 unless all of them) can be
+	// shipped in a single message of at most 'maxBytes'
+	virtual unsigned long fitVectors(unsigned long bits, uint8_t *tms, uint8_t *tdi, unsigned maxBytes);
 
 	static Xid           getXid(Header x);
 	static uint32_t      getCmd(Header x);
+
+	// is 'rep' the reply to request 'req'? (errors are considered a reply)
+	static bool          isReply(Header req, Header rep);
 	static unsigned      getErr(Header x);
 	static unsigned long getLen(Header x);
 	static Header        getVrs(Header x);
@@ -325,6 +600,10 @@ protected:
 	virtual unsigned getMemDepth();
 	virtual uint32_t getPeriodNs();
 
+	// announce how many messages the transport can have in flight
+	// (requires 'xmit()' and 'recv()' to be implemented)
+	virtual void     setMaxInFlight(unsigned n);
+
 public:
 
 	JtagDriverAxisToJtag( int argc, char *const argv[], unsigned debug = 0 );
@@ -340,6 +619,42 @@ public:
 	virtual int
 	xfer( uint8_t *txb, unsigned txBytes, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size ) = 0;
 
+	// split-phase transport primitives (optional; the default implementations
+	// throw). 'xmit' sends a message; 'recv' receives the next reply from the
+	// target (whatever transaction it belongs to) and otherwise behaves like
+	// 'xfer'.
+	virtual void
+	xmit( uint8_t *txb, unsigned txBytes );
+
+	virtual int
+	recv( uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size );
+
+	// batched variants of the split-phase primitives; the default
+	// implementations use 'xmit()' and 'recv()', respectively.
+	// 'recvv' waits for at least one reply and may receive up to 'n'. The
+	// payload size of reply 'i' is stored in 'gots[i]' (-1 if it was
+	// truncated). RETURNS: number of replies received.
+	virtual void
+	xmitv( uint8_t * const *txbs, const unsigned *txBytes, unsigned n );
+
+	virtual unsigned
+	recvv( uint8_t * const *hdbufs, unsigned hsize, uint8_t * const *rxbs, const unsigned *sizes, int *gots, unsigned n );
+
+	// event-driven transport primitives (optional). 'getRxFd()' returns a
+	// descriptor which becomes readable when a reply arrives (the default
+	// returns -1: not supported). 'tryRecvv()' works like 'recvv()' but
+	// never blocks and may thus return 0; it throws a TimeoutErr once the
+	// reply is overdue. 'getRxTimeout()' is the time (ms) left until then
+	// (-1: the transport does not time out).
+	virtual int
+	getRxFd();
+
+	virtual unsigned
+	tryRecvv( uint8_t * const *hdbufs, unsigned hsize, uint8_t * const *rxbs, const unsigned *sizes, int *gots, unsigned n );
+
+	virtual int
+	getRxTimeout();
+
 	// Transfer with retry/timeout.
 	// 'txBytes' are transmitted from the TX buffer 'txb'.
 	// The message header is received into '*phdr', payload (of up to 'sizeBytes') into 'rxb'.
@@ -347,16 +662,34 @@ public:
 	virtual int
 	xferRel( uint8_t *txb, unsigned txBytes, Header *phdr, uint8_t *rxb, unsigned sizeBytes );
 
-	// XVC query ("getinfo")
+	// XVC query ("getinfo"); the result may be cached (see 'setQueryTtl()')
 	virtual unsigned long
 	query();
 
+	virtual void
+	setQueryTtl(unsigned ms);
+
+	virtual void
+	resetQuery();
+
 	virtual uint32_t
 	setPeriodNs(uint32_t newPeriod);
 
 	// XVC send vectors ("shift")
 	virtual void sendVectors(unsigned long bits, uint8_t *tms, uint8_t *tdi, uint8_t *tdo);
 
+	// pipelined shifting
+	virtual void     submitVectors(unsigned long bits, uint8_t *tms, uint8_t *tdi, uint8_t *tdo);
+	virtual void     flushVectors();
+	virtual void     completeVectors();
+	virtual unsigned getMaxInFlight();
+
+	// event-driven completion
+	virtual int      asyncVectors();
+	virtual bool     pollVectors();
+	virtual int      getPollTimeout();
+	virtual void     abortVectors();
+
 	virtual void dumpInfo(FILE *f);
 
 	static void usage();
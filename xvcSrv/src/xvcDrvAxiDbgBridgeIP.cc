@@ -115,6 +115,11 @@ struct   timespec then, now;
 	pi += wsz;
 
 	if ( getVrs(hdr) != PVER0 ) {
+		if ( getCmd(hdr) == CMD_Q ) {
+			// reject like firmware does; the caller falls back to PVER0
+			setHdr( hdbuf, PVER0 | CMD_E | ERR_BAD_VERSION );
+			return 0;
+		}
 		throw std::runtime_error("AxiDbgBridgeIP driver: xfer() found unexpected version");
 	}
 
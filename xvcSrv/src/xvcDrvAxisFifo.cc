@@ -16,6 +16,7 @@
 
 #include <xvcDrvAxisFifo.h>
 #include <unistd.h>
+#include <poll.h>
 
 JtagDriverZynqFifo::JtagDriverZynqFifo(int argc, char *const argv[], const char *devnam)
 : JtagDriverAxisToJtag( argc, argv ),
@@ -90,6 +91,37 @@ uint32_t evs = 0;
 	return evs;
 }
 
+void
+JtagDriverZynqFifo::arm()
+{
+uint32_t evs = 1;
+
+	if ( sizeof(evs) != write( map_.fd(), &evs, sizeof(evs) ) ) {
+		throw SysErr("Unable to write to IRQ descriptor");
+	}
+}
+
+void
+JtagDriverZynqFifo::ack()
+{
+struct pollfd p;
+uint32_t      evs;
+
+	p.fd     = map_.fd();
+	p.events = POLLIN;
+	if ( poll( &p, 1, 0 ) > 0 ) {
+		if ( sizeof(evs) != read( map_.fd(), &evs, sizeof(evs) ) ) {
+			throw SysErr("Unable to read from IRQ descriptor");
+		}
+	}
+}
+
+bool
+JtagDriverZynqFifo::rxReady()
+{
+	return !! (i32( RX_STA_IDX ) & (1<<RX_RDY_SHF));
+}
+
 void
 JtagDriverZynqFifo::reset()
 {
@@ -138,28 +170,72 @@ JtagDriverZynqFifo::getMaxVectorSize()
 	return maxVec_;
 }
 
-int
-JtagDriverZynqFifo::xfer( uint8_t *txb, unsigned txBytes, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size )
+void
+JtagDriverZynqFifo::xmit( uint8_t *txb, unsigned txBytes )
 {
 unsigned txWords   = (txBytes + 3)/4;
 uint32_t lastBytes = txBytes - 4*(txWords - 1);
 unsigned i;
-unsigned got, min, minw, rem;
 uint32_t w;
 
-	if ( hsize % 4 != 0 ) {
-		throw std::runtime_error("zynq FIFO only supports word-lengths that are a multiple of 4");
-	}
-
 	for ( i=0; i<txWords; i++ ) {
 		memcpy( &w, &txb[4*i], 4 );
 		o32( TX_DAT_IDX, w );
 	}
 	o32( TX_END_IDX, lastBytes );
+}
 
-	while ( ! (i32( RX_STA_IDX ) & (1<<RX_RDY_SHF)) ) {
+int
+JtagDriverZynqFifo::recv( uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size )
+{
+	while ( ! rxReady() ) {
 		wait();
 	}
+	return rxMsg( hdbuf, hsize, rxb, size );
+}
+
+int
+JtagDriverZynqFifo::getRxFd()
+{
+	// in polled mode there is nothing to wait for
+	return useIrq_ ? map_.fd() : -1;
+}
+
+unsigned
+JtagDriverZynqFifo::tryRecvv( uint8_t * const *hdbufs, unsigned hsize, uint8_t * const *rxbs, const unsigned *sizes, int *gots, unsigned )
+{
+	ack();
+	if ( ! rxReady() ) {
+		// re-enable the interrupt and look again; the reply might
+		// have arrived in the meantime
+		arm();
+		if ( ! rxReady() ) {
+			return 0;
+		}
+	}
+	gots[0] = rxMsg( hdbufs[0], hsize, rxbs[0], sizes[0] );
+	return 1;
+}
+
+int
+JtagDriverZynqFifo::xfer( uint8_t *txb, unsigned txBytes, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size )
+{
+	xmit( txb, txBytes );
+	return recv( hdbuf, hsize, rxb, size );
+}
+
+// read a reply which is ready in the RX FIFO
+int
+JtagDriverZynqFifo::rxMsg( uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size )
+{
+unsigned i;
+unsigned got, min, minw, rem;
+uint32_t w;
+
+	if ( hsize % 4 != 0 ) {
+		throw std::runtime_error("zynq FIFO only supports word-lengths that are a multiple of 4");
+	}
+
 	/* clear status */
 	o32( RX_STA_IDX, (1<<RX_RDY_SHF) );
 
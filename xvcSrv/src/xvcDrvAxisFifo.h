@@ -58,6 +58,17 @@ public:
 
 	virtual uint32_t wait();
 
+	// (re-)enable the interrupt
+	virtual void     arm();
+
+	// consume a pending interrupt (does not block)
+	virtual void     ack();
+
+	virtual bool     rxReady();
+
+	// read the reply which is ready
+	virtual int      rxMsg( uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size );
+
 	JtagDriverZynqFifo(int argc, char *const argv[], const char *devnam);
 
 	virtual void
@@ -69,6 +80,19 @@ public:
 	virtual int
 	xfer( uint8_t *txb, unsigned txBytes, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size );
 
+	// split-phase and event-driven primitives (one message in flight)
+	virtual void
+	xmit( uint8_t *txb, unsigned txBytes );
+
+	virtual int
+	recv( uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size );
+
+	virtual int
+	getRxFd();
+
+	virtual unsigned
+	tryRecvv( uint8_t * const *hdbufs, unsigned hsize, uint8_t * const *rxbs, const unsigned *sizes, int *gots, unsigned n );
+
 	virtual ~JtagDriverZynqFifo();
 
 	static void usage();
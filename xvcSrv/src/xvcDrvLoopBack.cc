@@ -21,7 +21,8 @@ JtagDriverLoopBack::JtagDriverLoopBack(int argc, char *const argv[], const char
 : JtagDriverAxisToJtag(argc, argv   ),
   skip_   ( 0 == fnam || 0 == *fnam ),
   line_   ( 1                       ),
-  tdoOnly_( false                   )
+  tdoOnly_( false                   ),
+  forget_ ( 0                       )
 {
 	if ( fnam && *fnam ) {
 		if ( ! (f_ = fopen(fnam, "r")) ) {
@@ -141,12 +142,153 @@ JtagDriverLoopBack::emulWordSize()
 	return 4;
 }
 
+void
+JtagDriverLoopBack::setQueryTtl(unsigned)
+{
+	JtagDriverAxisToJtag::setQueryTtl( 0 );
+}
+
 unsigned
 JtagDriverLoopBack::emulMemDepth()
 {
 	return 0; // no memory = reliable channel required!
 }
 
+JtagDriverLoopBack::Header
+JtagDriverLoopBack::emulVersion()
+{
+	return PVER1;
+}
+
+uint32_t
+JtagDriverLoopBack::emulCaps()
+{
+	// 32 macros of up to 4 word pairs
+	return CAP_TDI_SHIFT | (32 << CAP_SLOTS_SHIFT) | (4 << CAP_PAIRS_SHIFT);
+}
+
+unsigned
+JtagDriverLoopBack::macroDecode(uint8_t *txb, unsigned txBytes, Header h, unsigned *err)
+{
+const unsigned   wsz   = emulWordSize();
+unsigned long    bits  = getLen( h );
+unsigned long    nw    = ((bits + 7)/8 + wsz - 1)/wsz;
+unsigned         slot  = (h & X_SLOT_MASK) >> X_SLOT_SHIFT;
+uint32_t         caps  = emulCaps();
+vector<uint8_t> *m;
+
+	if ( slot >= ((caps >> CAP_SLOTS_SHIFT) & 0xff) || nw > ((caps >> CAP_PAIRS_SHIFT) & 0xff) ) {
+		*err = ERR_BAD_COMMAND;
+		return 0;
+	}
+	if ( emulMacros_.size() <= slot ) {
+		emulMacros_.resize( slot + 1 );
+	}
+	m = &emulMacros_[ slot ];
+
+	if ( X_OP_DEFINE == (h & X_OP_MASK) ) {
+		if ( txBytes < wsz + 2*nw*wsz ) {
+			*err = ERR_TRUNCATED;
+			return 0;
+		}
+		m->assign( txb + wsz, txb + wsz + 2*nw*wsz );
+		// the payload is in the PVER0 layout already
+		raw_.assign( txb, txb + wsz + 2*nw*wsz );
+	} else {
+		if ( mfEn_ && 0 == ((++forget_) & 0x3f) ) {
+			// pretend we were reloaded
+			emulMacros_.clear();
+			emulMacros_.resize( slot + 1 );
+			m = &emulMacros_[ slot ];
+		}
+		if ( m->size() < 2*nw*wsz ) {
+			*err = ERR_NO_MACRO;
+			return 0;
+		}
+		raw_.resize( wsz + 2*nw*wsz );
+		memcpy( &raw_[0],   txb,       wsz          );
+		memcpy( &raw_[wsz], &(*m)[0],  2*nw*wsz     );
+	}
+	return raw_.size();
+}
+
+unsigned
+JtagDriverLoopBack::tdiDecode(uint8_t *txb, unsigned txBytes, unsigned long bits, Header op)
+{
+const unsigned wsz = emulWordSize();
+unsigned long  nw  = ((bits + 7)/8 + wsz - 1)/wsz;
+unsigned long  w;
+
+	if ( txBytes < wsz + nw*wsz ) {
+		return 0;
+	}
+
+	raw_.resize( wsz + 2*nw*wsz );
+	memcpy( &raw_[0], txb, wsz );
+
+	for ( w = 0; w < nw; w++ ) {
+		memset( &raw_[ wsz + 2*w*wsz       ], 0,                 wsz );
+		memcpy( &raw_[ wsz + 2*w*wsz + wsz ], &txb[wsz + w*wsz], wsz );
+	}
+	if ( X_OP_TDI_EXIT == op ) {
+		raw_[ wsz + 2*(nw - 1)*wsz + ((bits - 1) % (8*wsz))/8 ] = 1 << ((bits - 1) % 8);
+	}
+	return raw_.size();
+}
+
+unsigned
+JtagDriverLoopBack::rleDecode(uint8_t *txb, unsigned txBytes, unsigned long bits)
+{
+const unsigned wsz = emulWordSize();
+unsigned long  nw  = ((bits + 7)/8 + wsz - 1)/wsz;
+unsigned long  w   = 0;
+unsigned long  run;
+unsigned       i   = wsz;
+unsigned       k;
+uint32_t       ctl;
+uint8_t       *dst;
+
+	raw_.resize( wsz + 2*nw*wsz );
+	memcpy( &raw_[0], txb, wsz );
+
+	while ( w < nw ) {
+		if ( i + wsz > txBytes ) {
+			return 0;
+		}
+		ctl  = getValLE( &txb[i], 4 );
+		i   += wsz;
+		run  = ((ctl >> RLE_CNT_SHIFT) & (RLE_MAX_RUN - 1)) + 1;
+		if ( w + run > nw ) {
+			return 0;
+		}
+		while ( run-- > 0 ) {
+			// TMS, then TDI
+			for ( k = 0; k < 2; k++ ) {
+				dst = &raw_[ wsz + (2*w + k)*wsz ];
+				switch ( (ctl >> (k*RLE_TDI_SHIFT)) & RLE_MODE_MASK ) {
+					case RLE_LIT:
+						if ( i + wsz > txBytes ) {
+							return 0;
+						}
+						memcpy( dst, &txb[i], wsz );
+						i += wsz;
+						break;
+					case RLE_ZEROS:
+						memset( dst, 0x00, wsz );
+						break;
+					case RLE_ONES:
+						memset( dst, 0xff, wsz );
+						break;
+					default:
+						return 0;
+				}
+			}
+			w++;
+		}
+	}
+	return raw_.size();
+}
+
 
 int
 JtagDriverLoopBack::xfer( uint8_t *txb, unsigned txBytes, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size )
@@ -159,7 +301,7 @@ unsigned       bytes;
 unsigned       rem;
 unsigned       wbytes;
 const unsigned wsz = emulWordSize();
-const unsigned dpt = emulMemDepth();
+unsigned       dpt;
 char           cbuf[1024];
 
 	if ( txBytes < 4 )
@@ -168,11 +310,13 @@ char           cbuf[1024];
 	i = 0;
 	uint32_t h = (((((txb[i+3]<<8)|txb[i+2])<<8)|txb[i+1])<<8)|txb[i+0];
 
-	if ( getVrs(h) != PVER0 ) {
-		h = (h & ~(CMD_MASK | LEN_MASK)) | (CMD_E | 2 );
+	if ( getVrs(h) > emulVersion() ) {
+		// reply with the version we support
+		h = (h & ~(VRS_MASK | CMD_MASK | LEN_MASK)) | emulVersion() | (CMD_E | ERR_BAD_VERSION );
 	} else {
 		switch ( (cmd = getCmd( h )) ) {
 			case CMD_Q:
+				dpt = emulMemDepth();
 				h |= ((dpt & 0xfffff) << 4 ) | (wsz-1);
 				if ( getDebug() > 1 ) {
 					fprintf(stderr, "QUERY \n");
@@ -181,14 +325,46 @@ char           cbuf[1024];
 					fseek( f_, 0, SEEK_SET );
 					skip_ = false;
 				}
+				if ( PVER1 == getVrs( h ) ) {
+					setValLE( emulCaps(), rxb, wsz );
+					rval = wsz;
+				}
 				break;
 
+			case CMD_X:
+				if ( PVER1 != getVrs( h ) ) {
+					h = (h & ~(CMD_MASK | LEN_MASK)) | (CMD_E | ERR_BAD_COMMAND );
+					break;
+				}
+				/* fall through */
 			case CMD_S:
 				if ( getDebug() > 1 ) {
 					fprintf(stderr, "SHIFT\n");
 				}
 				bits = getLen( h );
 
+				if ( CMD_X == cmd ) {
+					unsigned err = ERR_TRUNCATED;
+					if ( X_OP_DEFINE == (h & X_OP_MASK) || X_OP_MACRO == (h & X_OP_MASK) ) {
+						txBytes = macroDecode( txb, txBytes, h, &err );
+					} else {
+						txBytes = tdiDecode( txb, txBytes, bits, h & X_OP_MASK );
+					}
+					if ( 0 == txBytes ) {
+						h = (h & ~(CMD_MASK | LEN_MASK)) | (CMD_E | err );
+						break;
+					}
+					txb = &raw_[0];
+				} else if ( PVER1 == getVrs( h ) ) {
+					// the reference decoder; the rest works on the
+					// PVER0 layout
+					if ( 0 == (txBytes = rleDecode( txb, txBytes, bits )) ) {
+						h = (h & ~(CMD_MASK | LEN_MASK)) | (CMD_E | ERR_TRUNCATED );
+						break;
+					}
+					txb = &raw_[0];
+				}
+
 				checkLEN( bits );
 
 				bytes  = (bits + 7 )/8;
@@ -246,7 +422,8 @@ UdpLoopBack::UdpLoopBack(const char *fnam, unsigned port)
 struct sockaddr_in a;
 int               yes = 1;
 
-	rbuf_.reserve(1500);
+	// a PVER1 client may send up to its own MTU
+	rbuf_.reserve(65536);
 	tbuf_.reserve(1500);
 
 	a.sin_family      = AF_INET;
@@ -284,6 +461,7 @@ bool   isNewShift = false;
 			break;
 
 		case CMD_S:
+		case CMD_X:
 			if ( getXid( txh ) == getXid( rxh ) ) {
 				// retry!
 				if ( tsiz_ < 0 ) {
@@ -315,6 +493,14 @@ UdpLoopBack::emulMemDepth()
 	return 1450/2/emulWordSize() - 1;
 }
 
+uint32_t
+UdpLoopBack::emulCaps()
+{
+	// the client fits (compressed) messages into its MTU; only the
+	// reply (TDO plus header) is bounded by ours
+	return JtagDriverLoopBack::emulCaps() | (((1450/emulWordSize() - 1)/CAP_VLEN_UNIT) << CAP_VLEN_SHIFT);
+}
+
 void
 UdpLoopBack::run()
 {
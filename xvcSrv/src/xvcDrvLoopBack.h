@@ -36,14 +36,41 @@ private:
     bool          skip_;
 	bool          tdoOnly_;
 	unsigned long line_;
+	// PVER1 shift expanded into the PVER0 layout
+	vector<uint8_t> raw_;
+	// macro slots (TMS/TDI pairs in the PVER0 layout)
+	vector< vector<uint8_t> > emulMacros_;
+	// macro commands executed (test mode 2 forgets the macros now and then)
+	unsigned      forget_;
 public:
 
 	JtagDriverLoopBack(int argc, char *const argv[], const char *fnam = 0);
 
 	virtual ~JtagDriverLoopBack();
 
+	// the emulation starts over (rewinds the test data) when it is
+	// queried, i.e., for every connection; the query must not be cached
+	virtual void     setQueryTtl(unsigned ms);
+
 	virtual unsigned emulWordSize();
 	virtual unsigned emulMemDepth();
+	// most recent protocol version the emulated firmware speaks
+	virtual Header   emulVersion();
+	// capabilities it announces (PVER1)
+	virtual uint32_t emulCaps();
+
+	// expand the run-length encoded payload of a PVER1 shift of 'bits'
+	// into 'raw_'; RETURNS: size of the PVER0 message or 0 if the
+	// payload is malformed
+	virtual unsigned rleDecode(uint8_t *txb, unsigned txBytes, unsigned long bits);
+
+	// ditto for an implicit-TMS shift (extended command 'op')
+	virtual unsigned tdiDecode(uint8_t *txb, unsigned txBytes, unsigned long bits, Header op);
+
+	// execute a macro command: store the payload in or expand it from
+	// the slot. RETURNS: size of the PVER0 message or 0 (and sets
+	// '*err') if the command is rejected
+	virtual unsigned macroDecode(uint8_t *txb, unsigned txBytes, Header h, unsigned *err);
 
 	virtual bool rdl(char *buf, size_t bufsz);
 
@@ -86,6 +113,10 @@ public:
 	virtual unsigned
 	emulMemDepth();
 
+	// PVER1 shifts are limited by our MTU rather than the memory depth
+	virtual uint32_t
+	emulCaps();
+
 	void run();
 
 	virtual ~UdpLoopBack();
@@ -24,11 +24,45 @@ static const char *DFLT_PORT="2542";
 
 static const unsigned MAXL  = 256;
 
+// RFC 6298 parameters
+static const unsigned long RTO_INITIAL_US = 500000; // until we have a sample
+static const unsigned long RTO_CLOCK_G_US =   1000; // poll() granularity
+static const unsigned      RTO_K          =      4;
+
+// IPv4 + UDP headers; IP_MTU includes these
+static const unsigned      IP_UDP_HDRS    = 20 + 8;
+
+static unsigned long
+usSince(const struct timespec *then)
+{
+struct timespec now;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return (now.tv_sec - then->tv_sec)*1000000UL + now.tv_nsec/1000 - then->tv_nsec/1000;
+}
+
 JtagDriverUdp::JtagDriverUdp(int argc, char *const argv[], const char *target)
 : JtagDriverAxisToJtag( argc, argv ),
-  sock_      ( false ),
-  timeoutMs_ ( 500   ),
-  mtu_       ( 1450  ) // ethernet mtu minus MAC/IP/UDP addresses
+  sock_      ( false          ),
+  minRtoUs_  ( 20000          ),
+  maxRtoUs_  ( 2000000        ),
+  srttUs_    ( 0              ),
+  rttvarUs_  ( 0              ),
+  rtoUs_     ( RTO_INITIAL_US ),
+  haveRtt_   ( false          ),
+  backoff_   ( 0              ),
+  retrans_   ( false          ),
+  lastXid_   ( XID_ANY        ),
+  spinUs_    ( 0              ),
+  spinHits_  ( 0              ),
+  spinFallbacks_( 0           ),
+  busyPollUs_( 0              ),
+  ring_      ( 0              ),
+  mtu_       ( 1450           ), // ethernet mtu minus MAC/IP/UDP addresses
+  userMtu_   ( 0              ),
+  probeUs_   ( 60000000       ),
+  pmtuShrinks_( 0             ),
+  pmtuGrows_ ( 0              )
 {
 struct addrinfo hint, *res;
 const char            *col, *prtnam;
@@ -37,11 +71,16 @@ unsigned               l;
 int                    stat, opt;
 unsigned               mtu;
 unsigned              *i_p;
-socklen_t              slen;
 bool                   userMtu = false;
 bool                   frag    = false;
+unsigned               depth   = 1;
+unsigned               minRto  = minRtoUs_/1000;
+unsigned               maxRto  = maxRtoUs_/1000;
+unsigned               probe   = probeUs_/1000000;
+unsigned               spin    = 0;
+bool                   uring   = false;
 
-	while ( (opt = getopt(argc, argv, "m:f")) > 0 ) {
+	while ( (opt = getopt(argc, argv, "m:fw:r:R:p:s:b:u")) > 0 ) {
 
 		i_p = 0;
 
@@ -55,6 +94,34 @@ bool                   frag    = false;
 				frag    = true;
 			break;
 
+			case 'w':
+				i_p     = &depth;
+			break;
+
+			case 'r':
+				i_p     = &minRto;
+			break;
+
+			case 'R':
+				i_p     = &maxRto;
+			break;
+
+			case 'p':
+				i_p     = &probe;
+			break;
+
+			case 's':
+				i_p     = &spin;
+			break;
+
+			case 'b':
+				i_p     = &busyPollUs_;
+			break;
+
+			case 'u':
+				uring   = true;
+			break;
+
 			default:
 				fprintf(stderr,"Unknown driver option -%c\n", opt);
 				throw std::runtime_error("Unknown driver option");
@@ -68,6 +135,21 @@ bool                   frag    = false;
 		}
 	}
 
+	if ( 0 == minRto || minRto > maxRto ) {
+		fprintf(stderr,"Invalid retransmission timeout limits (need 0 < min <= max)\n");
+		throw std::runtime_error("Invalid driver option value");
+	}
+	minRtoUs_ = minRto*1000UL;
+	maxRtoUs_ = maxRto*1000UL;
+	probeUs_  = probe*1000000UL;
+	spinUs_   = spin;
+	if ( rtoUs_ < minRtoUs_ ) {
+		rtoUs_ = minRtoUs_;
+	}
+	if ( rtoUs_ > maxRtoUs_ ) {
+		rtoUs_ = maxRtoUs_;
+	}
+
 	if ( (col = strchr(target, ':')) ) {
 
 		l = col - target;
@@ -105,10 +187,13 @@ bool                   frag    = false;
 		}
 	}
 
+	if ( userMtu ) {
+		userMtu_ = mtu_;
+	}
+
 	// find current MTU
-    slen = sizeof(mtu);
-	stat = getsockopt( sock_.getSd(), IPPROTO_IP, IP_MTU, &mtu, &slen );
-	if ( stat ) {
+	mtu = pathMtu();
+	if ( 0 == mtu ) {
 		fprintf(stderr,"Warning: Unable to estimate MTU (getsockopt(IP_MTU) failed: %s) -- using %d\n", strerror(errno), mtu_);
 	} else {
 		if ( mtu < mtu_ ) {
@@ -128,12 +213,39 @@ bool                   frag    = false;
 		}
 	}
 
+	if ( busyPollUs_ ) {
+		// let the kernel poll the NIC while we spin; may need CAP_NET_ADMIN
+		opt  = busyPollUs_;
+		if ( setsockopt( sock_.getSd(), SOL_SOCKET, SO_BUSY_POLL, &opt, sizeof(opt) ) ) {
+			fprintf(stderr,"Warning: Unable to set SO_BUSY_POLL: %s\n", strerror(errno));
+		}
+#ifdef SO_PREFER_BUSY_POLL
+		opt  = 1;
+		if ( setsockopt( sock_.getSd(), SOL_SOCKET, SO_PREFER_BUSY_POLL, &opt, sizeof(opt) ) ) {
+			fprintf(stderr,"Warning: Unable to set SO_PREFER_BUSY_POLL: %s\n", strerror(errno));
+		}
+#endif
+	}
+
 	poll_[0].fd     = sock_.getSd();
 	poll_[0].events = POLLIN;
+
+	if ( uring ) {
+		try {
+			ring_ = new XvcUring( sock_.getSd() );
+		} catch ( std::runtime_error &e ) {
+			fprintf(stderr,"Warning: io_uring not available (%s); using plain system calls\n", e.what());
+		}
+	}
+
+	clock_gettime( CLOCK_MONOTONIC, &lastProbe_ );
+
+	setMaxInFlight( depth );
 }
 
 JtagDriverUdp::~JtagDriverUdp()
 {
+	delete ring_;
 }
 
 
@@ -150,35 +262,291 @@ JtagDriverUdp::init()
 unsigned long
 JtagDriverUdp::getMaxVectorSize()
 {
-// MTU lim; 2*vector size + header must fit!
-unsigned long mtuLim    = (mtu_ - getWordSize()) / 2;
+unsigned long mtuLim;
+
+	// this is consulted for every shift; a good time to check whether
+	// we may use bigger messages
+	pmtuProbe();
+
+	if ( PVER1 == getProtoVers() && syncVectors() && (getCaps() & CAP_VLEN_MASK) ) {
+		// the target accepts shifts longer than its memory depth; the
+		// TDO reply must fit. 'sendVectors()' splits what does not
+		// compress well enough. Leave room for the header, two control
+		// words and a literal TMS word (the final TMS bit of a scan).
+		mtuLim = ((mtu_ - 4*getWordSize()) / getWordSize()) * getWordSize();
+		return mtuLim < getTgtVecSize() ? mtuLim : getTgtVecSize();
+	}
 
-		return mtuLim;
+	// MTU lim; 2*vector size + header must fit! The vectors are
+	// padded to whole words.
+	mtuLim = ((mtu_ - getWordSize()) / 2 / getWordSize()) * getWordSize();
+
+	return mtuLim;
 }
 
-int
-JtagDriverUdp::xfer( uint8_t *txb, unsigned txBytes, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size )
+unsigned
+JtagDriverUdp::pathMtu()
 {
-int got;
+int       mtu;
+socklen_t slen = sizeof(mtu);
+
+	if ( getsockopt( sock_.getSd(), IPPROTO_IP, IP_MTU, &mtu, &slen ) || mtu <= (int)IP_UDP_HDRS ) {
+		return 0;
+	}
+	mtu -= IP_UDP_HDRS;
+	// max. UDP payload
+	return mtu > 65535 - (int)IP_UDP_HDRS ? 65535 - IP_UDP_HDRS : mtu;
+}
+
+bool
+JtagDriverUdp::pmtuShrink(unsigned failed)
+{
+unsigned mtu = pathMtu();
+
+	// must actually shrink (or the caller would retry forever) and
+	// still be able to send a single word
+	if ( mtu >= failed || mtu >= mtu_ || mtu < 3*getWordSize() ) {
+		return false;
+	}
+
+	fprintf(stderr, "Note: path MTU dropped; reducing UDP message size from %d to %d octets\n", mtu_, mtu);
+
+	mtu_ = mtu;
+	pmtuShrinks_++;
+	// don't probe right back up
+	clock_gettime( CLOCK_MONOTONIC, &lastProbe_ );
+	return true;
+}
+
+void
+JtagDriverUdp::pmtuProbe()
+{
+unsigned mtu;
+
+	if ( 0 == probeUs_ || usSince( &lastProbe_ ) < probeUs_ ) {
+		return;
+	}
+	clock_gettime( CLOCK_MONOTONIC, &lastProbe_ );
+
+	// The kernel forgets a learned path MTU after a while
+	// (net.ipv4.route.mtu_expires) and then reports the route's MTU
+	// again. If the path really is still narrower we'll just see
+	// EMSGSIZE/ICMP again and shrink back.
+	if ( 0 == (mtu = pathMtu()) ) {
+		return;
+	}
+	if ( userMtu_ && mtu > userMtu_ ) {
+		mtu = userMtu_;
+	}
+	if ( mtu > mtu_ ) {
+		if ( debug_ > 0 ) {
+			fprintf(stderr, "JtagDriverUdp: path MTU grew; increasing UDP message size from %d to %d octets\n", mtu_, mtu);
+		}
+		mtu_ = mtu;
+		pmtuGrows_++;
+	}
+}
+
+void
+JtagDriverUdp::msgSizeErr(unsigned failed)
+{
+	if ( pmtuShrink( failed ) ) {
+		throw MsgSizeErr("JtagDriverUdp: message exceeds path MTU");
+	}
+	fprintf(stderr, "UDP message size too large; would require fragmentation!\n");
+	fprintf(stderr, "Try to reduce using the driver option -- -m <mtu_size>.\n");
+	throw SysErr("JtagDriverUdp: unable to send");
+}
+
+void
+JtagDriverUdp::sendVectors(unsigned long bits, uint8_t *tms, uint8_t *tdi, uint8_t *tdo)
+{
+unsigned long n;
+
+	// if the path MTU shrinks under our feet then re-split
+	// what the caller passed us
+	while ( bits > 0 ) {
+		n = fitVectors( bits, tms, tdi, mtu_ );
+		try {
+			JtagDriverAxisToJtag::sendVectors( n, tms, tdi, tdo );
+		} catch (MsgSizeErr &) {
+			continue;
+		}
+		bits -= n;
+		tms  += n/8;
+		tdi  += n/8;
+		tdo  += n/8;
+	}
+}
+
+void
+JtagDriverUdp::rttSample(unsigned long us)
+{
+unsigned long dev;
+
+	if ( ! haveRtt_ ) {
+		srttUs_   = us;
+		rttvarUs_ = us/2;
+		haveRtt_  = true;
+	} else {
+		dev       = srttUs_ > us ? srttUs_ - us : us - srttUs_;
+		rttvarUs_ = (3*rttvarUs_ + dev)/4;
+		srttUs_   = (7*srttUs_   + us )/8;
+	}
+
+	rtoUs_ = srttUs_ + ( RTO_K*rttvarUs_ > RTO_CLOCK_G_US ? RTO_K*rttvarUs_ : RTO_CLOCK_G_US );
+	if ( rtoUs_ < minRtoUs_ ) {
+		rtoUs_ = minRtoUs_;
+	}
+	if ( rtoUs_ > maxRtoUs_ ) {
+		rtoUs_ = maxRtoUs_;
+	}
+	backoff_ = 0;
+}
+
+unsigned long
+JtagDriverUdp::getRtoUs()
+{
+unsigned long rto = rtoUs_;
+unsigned      i;
+
+	for ( i = 0; i < backoff_ && rto < maxRtoUs_; i++ ) {
+		rto *= 2;
+	}
+	return rto > maxRtoUs_ ? maxRtoUs_ : rto;
+}
+
+void
+JtagDriverUdp::xmit( uint8_t *txb, unsigned txBytes )
+{
+Xid xid = getXid( getHdr( txb ) );
+
+	// Karn: don't take RTT samples from retransmitted messages
+	retrans_ = ( xid == lastXid_ );
+	lastXid_ = xid;
+	clock_gettime( CLOCK_MONOTONIC, &sent_ );
+
+	if ( ring_ ) {
+		// goes out with the receive
+		ring_->send( txb, txBytes );
+		return;
+	}
 
 	if ( write( poll_[0].fd, txb, txBytes ) < 0 ) {
 		if ( EMSGSIZE == errno ) {
-			fprintf(stderr, "UDP message size too large; would require fragmentation!\n");
-			fprintf(stderr, "Try to reduce using the driver option -- -m <mtu_size>.\n");
+			msgSizeErr( txBytes );
 		}
 		throw SysErr("JtagDriverUdp: unable to send");
 	}
+}
 
-	poll_[0].revents = 0;
+void
+JtagDriverUdp::xmitv( uint8_t * const *txbs, const unsigned *txBytes, unsigned n )
+{
+unsigned i;
+int      put;
 
-	got = poll( poll_, sizeof(poll_)/sizeof(poll_[0]), timeoutMs_ /* ms */ );
+	if ( n == 0 ) {
+		return;
+	}
 
-	if ( got < 0 ) {
-		throw SysErr("JtagDriverUdp: poll failed");
+	// the window is always (re-)sent from the start; only sample the
+	// RTT if a single, new message goes out (see 'mmsgResult()')
+	retrans_ = ( n > 1 || getXid( getHdr( txbs[n-1] ) ) == lastXid_ );
+	lastXid_ = getXid( getHdr( txbs[n-1] ) );
+	clock_gettime( CLOCK_MONOTONIC, &sent_ );
+
+	if ( ring_ ) {
+		for ( i = 0; i < n; i++ ) {
+			ring_->send( txbs[i], txBytes[i] );
+		}
+		return;
+	}
+
+	mmsgReserve( n );
+
+	for ( i = 0; i < n; i++ ) {
+		mmiov_[i].iov_base = txbs[i];
+		mmiov_[i].iov_len  = txBytes[i];
+		memset( &mmsgs_[i], 0, sizeof(mmsgs_[i]) );
+		mmsgs_[i].msg_hdr.msg_iov    = &mmiov_[i];
+		mmsgs_[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	for ( i = 0; i < n; i += put ) {
+		put = sendmmsg( poll_[0].fd, &mmsgs_[i], n - i, 0 );
+		if ( put <= 0 ) {
+			if ( EMSGSIZE == errno ) {
+				// messages in flight can't be re-split; the next shift
+				// uses the new size
+				msgSizeErr( txBytes[i] );
+			}
+			throw SysErr("JtagDriverUdp: unable to send (sendmmsg)");
+		}
+	}
+}
+
+void
+JtagDriverUdp::mmsgReserve(unsigned n)
+{
+	if ( mmsgs_.size() < n ) {
+		mmsgs_.resize( n );
+		mmiov_.resize( 2*n );
+	}
+}
+
+// spin until data are available but no longer than 'limUs'
+bool
+JtagDriverUdp::spinRx(unsigned long limUs)
+{
+struct timespec start;
+
+	clock_gettime( CLOCK_MONOTONIC, &start );
+	do {
+		// a zero-length peek doesn't consume the datagram
+		if ( ::recv( poll_[0].fd, 0, 0, MSG_DONTWAIT | MSG_PEEK | MSG_TRUNC ) >= 0 ) {
+			return true;
+		}
+		if ( EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno ) {
+			throw SysErr("JtagDriverUdp: recv (busy-poll) failed");
+		}
+	} while ( usSince( &start ) < limUs );
+
+	return false;
+}
+
+// wait until data are available or throw a TimeoutErr
+void
+JtagDriverUdp::waitRx()
+{
+int           got;
+unsigned long rto     = getRtoUs();
+unsigned long elapsed = usSince( &sent_ );
+
+	if ( spinUs_ && elapsed < rto ) {
+		if ( spinRx( rto - elapsed < spinUs_ ? rto - elapsed : spinUs_ ) ) {
+			spinHits_++;
+			return;
+		}
+		spinFallbacks_++;
+		elapsed = usSince( &sent_ );
+	}
+
+	// the deadline is relative to the last transmission; thus, draining
+	// stale replies does not extend the timeout.
+	got = 0;
+	if ( elapsed < rto ) {
+		poll_[0].revents = 0;
+
+		got = poll( poll_, sizeof(poll_)/sizeof(poll_[0]), (rto - elapsed + 999)/1000 /* ms */ );
+
+		if ( got < 0 ) {
+			throw SysErr("JtagDriverUdp: poll failed");
+		}
 	}
 
 	if ( got == 0 ) {
-		throw TimeoutErr();
+		rxTimeout( rto );
 	}
 
 	if ( poll_[0].revents & (POLLERR | POLLNVAL) ) {
@@ -188,14 +556,78 @@ int got;
 	if ( ! (poll_[0].revents & POLLIN) ) {
 		throw std::runtime_error("JtagDriverUdp -- poll with no data?");
 	}
+}
+
+void
+JtagDriverUdp::rxTimeout(unsigned long rto)
+{
+	if ( rto < maxRtoUs_ ) {
+		backoff_++;
+	}
+	if ( debug_ > 0 ) {
+		fprintf(stderr, "JtagDriverUdp: timeout after %lu us\n", rto);
+	}
+	throw TimeoutErr();
+}
+
+// submit the queued message(s) and wait for a reply; all in a single
+// system call.
+int
+JtagDriverUdp::ringRecv(struct msghdr *msg)
+{
+unsigned long rto     = getRtoUs();
+unsigned long elapsed = usSince( &sent_ );
+unsigned      len;
+int           got, err;
+
+	// same deadline as 'waitRx()'
+	got = ring_->recv( msg, elapsed < rto ? rto - elapsed : 0 );
+
+	if ( (err = ring_->getSendErr( &len )) ) {
+		if ( -EMSGSIZE == err ) {
+			msgSizeErr( len );
+		}
+		errno = -err;
+		throw SysErr("JtagDriverUdp: unable to send (io_uring)");
+	}
+
+	if ( -ETIME == got ) {
+		rxTimeout( rto );
+	}
+
+	if ( got < 0 ) {
+		errno = -got;
+		throw SysErr("JtagDriverUdp -- recvmsg failed (io_uring)");
+	}
+
+	return got;
+}
 
+int
+JtagDriverUdp::recv( uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size )
+{
+int           got;
 
 	iovs_[0].iov_base = hdbuf;
 	iovs_[0].iov_len  = hsize;
 	iovs_[1].iov_base = rxb;
 	iovs_[1].iov_len  = size;
 
-	got = readv( poll_[0].fd, iovs_, sizeof(iovs_)/sizeof(iovs_[0]) );
+	if ( ring_ ) {
+		memset( &msgh_, 0, sizeof(msgh_) );
+		msgh_.msg_iov    = iovs_;
+		msgh_.msg_iovlen = sizeof(iovs_)/sizeof(iovs_[0]);
+
+		got = ringRecv( &msgh_ );
+		// like 'readv()'
+		if ( got > (int)(hsize + size) ) {
+			got = hsize + size;
+		}
+	} else {
+		waitRx();
+
+		got = readv( poll_[0].fd, iovs_, sizeof(iovs_)/sizeof(iovs_[0]) );
+	}
 
 	if ( debug_ > 1 ) {
 		fprintf(stderr, "HSIZE %d, SIZE %d, got %d\n", hsize ,size, got );
@@ -214,12 +646,204 @@ int got;
 	return got;
 }
 
+unsigned
+JtagDriverUdp::recvv( uint8_t * const *hdbufs, unsigned hsize, uint8_t * const *rxbs, const unsigned *sizes, int *gots, unsigned n )
+{
+unsigned i;
+int      got;
+
+	if ( n == 0 ) {
+		return 0;
+	}
+
+	if ( ! ring_ ) {
+		waitRx();
+	}
+
+	mmsgSetup( hdbufs, hsize, rxbs, sizes, n );
+
+	i = 0;
+	if ( ring_ ) {
+		// the first one is waited for (along with sending the window)
+		got = ringRecv( &mmsgs_[0].msg_hdr );
+		mmsgs_[0].msg_len = got;
+		if ( got > (int)(hsize + sizes[0]) ) {
+			mmsgs_[0].msg_len              = hsize + sizes[0];
+			mmsgs_[0].msg_hdr.msg_flags   |= MSG_TRUNC;
+		}
+		i = 1;
+	}
+
+	got = 0;
+	if ( n > i ) {
+		// grab whatever is queued but don't wait for more
+		got = recvmmsg( poll_[0].fd, &mmsgs_[i], n - i, MSG_DONTWAIT, NULL );
+
+		if ( got < 0 ) {
+			if ( EAGAIN != errno && EWOULDBLOCK != errno ) {
+				throw SysErr("JtagDriverUdp -- recvmmsg failed");
+			}
+			got = 0;
+		}
+	}
+	got += i;
+
+	return mmsgResult( hdbufs, hsize, gots, got, n );
+}
+
+void
+JtagDriverUdp::mmsgSetup( uint8_t * const *hdbufs, unsigned hsize, uint8_t * const *rxbs, const unsigned *sizes, unsigned n )
+{
+unsigned i;
+
+	mmsgReserve( n );
+
+	for ( i = 0; i < n; i++ ) {
+		mmiov_[2*i+0].iov_base = hdbufs[i];
+		mmiov_[2*i+0].iov_len  = hsize;
+		mmiov_[2*i+1].iov_base = rxbs[i];
+		mmiov_[2*i+1].iov_len  = sizes[i];
+		memset( &mmsgs_[i], 0, sizeof(mmsgs_[i]) );
+		mmsgs_[i].msg_hdr.msg_iov    = &mmiov_[2*i];
+		mmsgs_[i].msg_hdr.msg_iovlen = 2;
+	}
+}
+
+unsigned
+JtagDriverUdp::mmsgResult( uint8_t * const *hdbufs, unsigned hsize, int *gots, unsigned got, unsigned n )
+{
+unsigned i;
+
+	if ( 0 == got ) {
+		return 0;
+	}
+
+	if ( debug_ > 1 ) {
+		fprintf(stderr, "HSIZE %d, batch of %d (max %d)\n", hsize, got, n );
+	}
+
+	for ( i = 0; i < got; i++ ) {
+		if ( mmsgs_[i].msg_len < hsize ) {
+			throw ProtoErr("JtagDriverUdp -- not enough header data received");
+		}
+		if ( mmsgs_[i].msg_hdr.msg_flags & MSG_TRUNC ) {
+			gots[i] = -1;
+		} else {
+			gots[i] = mmsgs_[i].msg_len - hsize;
+		}
+		// the reply to a message which was sent only once
+		if ( ! retrans_ && getXid( getHdr( hdbufs[i] ) ) == lastXid_ ) {
+			rttSample( usSince( &sent_ ) );
+			retrans_ = true;
+		}
+	}
+
+	return got;
+}
+
+int
+JtagDriverUdp::getRxFd()
+{
+	// io_uring holds the transmissions back until the (blocking) receive
+	return ring_ ? -1 : poll_[0].fd;
+}
+
+unsigned
+JtagDriverUdp::tryRecvv( uint8_t * const *hdbufs, unsigned hsize, uint8_t * const *rxbs, const unsigned *sizes, int *gots, unsigned n )
+{
+int           got;
+unsigned long rto;
+
+	if ( n == 0 ) {
+		return 0;
+	}
+
+	mmsgSetup( hdbufs, hsize, rxbs, sizes, n );
+
+	got = recvmmsg( poll_[0].fd, &mmsgs_[0], n, MSG_DONTWAIT, NULL );
+
+	if ( got < 0 ) {
+		if ( EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno ) {
+			throw SysErr("JtagDriverUdp -- recvmmsg failed");
+		}
+		// same deadline as 'waitRx()'
+		if ( usSince( &sent_ ) >= (rto = getRtoUs()) ) {
+			rxTimeout( rto );
+		}
+		return 0;
+	}
+
+	return mmsgResult( hdbufs, hsize, gots, got, n );
+}
+
+int
+JtagDriverUdp::getRxTimeout()
+{
+unsigned long rto     = getRtoUs();
+unsigned long elapsed = usSince( &sent_ );
+
+	return elapsed < rto ? (rto - elapsed + 999)/1000 : 0;
+}
+
+int
+JtagDriverUdp::xfer( uint8_t *txb, unsigned txBytes, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size )
+{
+int got;
+
+	xmit( txb, txBytes );
+
+	while ( 1 ) {
+		got = recv( hdbuf, hsize, rxb, size );
+		if ( isReply( getHdr( txb ), getHdr( hdbuf ) ) ) {
+			break;
+		}
+		// late reply to an earlier message; drain and keep waiting for ours
+		if ( debug_ > 1 ) {
+			fprintf(stderr, "JtagDriverUdp: dropping stale reply\n");
+		}
+	}
+
+	if ( ! retrans_ ) {
+		rttSample( usSince( &sent_ ) );
+	}
+
+	return got;
+}
+
+void
+JtagDriverUdp::dumpInfo(FILE *f)
+{
+	JtagDriverAxisToJtag::dumpInfo( f );
+	fprintf(f, "Smoothed RTT           (us) %lu\n", srttUs_);
+	fprintf(f, "RTT variance           (us) %lu\n", rttvarUs_);
+	fprintf(f, "Retransmit timeout     (us) %lu (limits %lu..%lu)\n", rtoUs_, minRtoUs_, maxRtoUs_);
+	fprintf(f, "UDP payload MTU    (octets) %u (shrunk %lu, grown %lu times)\n", mtu_, pmtuShrinks_, pmtuGrows_);
+	if ( ring_ ) {
+		fprintf(f, "io_uring enter calls        %lu\n", ring_->getEnters());
+	}
+	if ( spinUs_ ) {
+		fprintf(f, "Busy-poll budget       (us) %lu (SO_BUSY_POLL %u us)\n", spinUs_, busyPollUs_);
+		fprintf(f, "Busy-poll hits/fallbacks    %lu/%lu\n", spinHits_, spinFallbacks_);
+	}
+}
+
 void
 JtagDriverUdp::usage()
 {
-	printf("  UDP Driver options: [-m <mtu>]\n");
+	printf("  UDP Driver options: [-m <mtu>] [-f] [-w <depth>] [-r <ms>] [-R <ms>] [-p <s>] [-s <us>] [-b <us>] [-u]\n");
 	printf("  -m <mtu>    : Set MTU limit for UDP datagrams (must not be fragmented!)\n");
 	printf("  -f          : Enable IP fragmentation - note that FW does probably not support this!\n");
+	printf("  -w <depth>  : Max. number of messages in flight (default: 1). Only used if the\n");
+	printf("                target has no memory; otherwise retries would be unsafe.\n");
+	printf("  -r <ms>     : Lower bound for the adaptive retransmission timeout (default: 20)\n");
+	printf("  -R <ms>     : Upper bound for the retransmission timeout/backoff (default: 2000)\n");
+	printf("  -p <s>      : Interval for checking whether the path MTU has grown (default: 60;\n");
+	printf("                0 disables). Never exceeds the limit given with -m.\n");
+	printf("  -s <us>     : Busy-poll for up to <us> microseconds for a reply before blocking\n");
+	printf("                in poll() (default: 0, i.e., don't spin). Burns a CPU but lowers latency.\n");
+	printf("  -b <us>     : Set SO_BUSY_POLL (and SO_PREFER_BUSY_POLL) on the socket (default: 0).\n");
+	printf("  -u          : Use io_uring (if supported by the build and the kernel): a message and\n");
+	printf("                the wait for its reply cost a single system call. -s is ignored.\n");
 }
 
 static DriverRegistrar<JtagDriverUdp> r("udp");
@@ -18,8 +18,17 @@
 #define JTAG_DRIVER_UDP_H
 
 #include <xvcDriver.h>
+#include <xvcUring.h>
 #include <sys/socket.h>
 #include <poll.h>
+#include <time.h>
+
+// A datagram exceeded the path MTU; the driver has already
+// adjusted its MTU and the message may be re-split and resent.
+class MsgSizeErr : public SysErr {
+public:
+	MsgSizeErr(const char *prefix) : SysErr( prefix ) {}
+};
 
 class JtagDriverUdp : public JtagDriverAxisToJtag {
 private:
@@ -27,12 +36,76 @@ private:
 
 	struct pollfd     poll_[1];
 
-	int               timeoutMs_;
+	// retransmission timeout estimation (RFC 6298); all times in us
+	unsigned long     minRtoUs_;
+	unsigned long     maxRtoUs_;
+	unsigned long     srttUs_;
+	unsigned long     rttvarUs_;
+	unsigned long     rtoUs_;
+	bool              haveRtt_;
+	unsigned          backoff_;
+	struct timespec   sent_;
+	bool              retrans_;
+	Xid               lastXid_;
+
+	void              rttSample(unsigned long us);
+
+	// current timeout (including backoff)
+	unsigned long     getRtoUs();
 
 	struct msghdr     msgh_;
 	struct iovec      iovs_[2];
 
+	// batched I/O (sendmmsg/recvmmsg)
+	std::vector<struct mmsghdr> mmsgs_;
+	std::vector<struct iovec>   mmiov_;
+
+	void              mmsgReserve(unsigned n);
+
+	// set up 'mmsgs_' for receiving 'n' replies
+	void              mmsgSetup( uint8_t * const *hdbufs, unsigned hsize, uint8_t * const *rxbs, const unsigned *sizes, unsigned n );
+
+	// check 'got' replies received into 'mmsgs_' and store their sizes
+	unsigned          mmsgResult( uint8_t * const *hdbufs, unsigned hsize, int *gots, unsigned got, unsigned n );
+
+	void              waitRx();
+
+	// busy-polling; spin for up to 'spinUs_' before blocking in poll()
+	unsigned long     spinUs_;
+	unsigned long     spinHits_;
+	unsigned long     spinFallbacks_;
+	unsigned          busyPollUs_;
+
+	bool              spinRx(unsigned long limUs);
+
+	// optional io_uring backend (NULL if not used)
+	XvcUring         *ring_;
+
+	// receive with io_uring; returns the size of the datagram
+	int               ringRecv(struct msghdr *msg);
+
+	void              rxTimeout(unsigned long rto);
+
     unsigned          mtu_;
+
+	// path MTU tracking; 'userMtu_' (if nonzero) caps upward probing
+	unsigned          userMtu_;
+	unsigned long     probeUs_;
+	struct timespec   lastProbe_;
+	unsigned long     pmtuShrinks_;
+	unsigned long     pmtuGrows_;
+
+	// current path MTU (UDP payload) as known to the kernel; 0 if unknown
+	unsigned          pathMtu();
+
+	// shrink 'mtu_' after a message of 'failed' octets was rejected;
+	// returns false if this did not help
+	bool              pmtuShrink(unsigned failed);
+
+	// periodically check if the path MTU has grown
+	void              pmtuProbe();
+
+	void              msgSizeErr(unsigned failed);
 public:
 
 	JtagDriverUdp(int argc, char *const argv[], const char *target);
@@ -43,9 +116,36 @@ public:
 	virtual unsigned long
 	getMaxVectorSize();
 
+	virtual void
+	sendVectors(unsigned long bits, uint8_t *tms, uint8_t *tdi, uint8_t *tdo);
+
 	virtual int
 	xfer( uint8_t *txb, unsigned txBytes, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size );
 
+	virtual void
+	xmit( uint8_t *txb, unsigned txBytes );
+
+	virtual int
+	recv( uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size );
+
+	virtual void
+	xmitv( uint8_t * const *txbs, const unsigned *txBytes, unsigned n );
+
+	virtual unsigned
+	recvv( uint8_t * const *hdbufs, unsigned hsize, uint8_t * const *rxbs, const unsigned *sizes, int *gots, unsigned n );
+
+	virtual int
+	getRxFd();
+
+	virtual unsigned
+	tryRecvv( uint8_t * const *hdbufs, unsigned hsize, uint8_t * const *rxbs, const unsigned *sizes, int *gots, unsigned n );
+
+	virtual int
+	getRxTimeout();
+
+	virtual void
+	dumpInfo(FILE *f);
+
 	virtual ~JtagDriverUdp();
 
 	static void usage();
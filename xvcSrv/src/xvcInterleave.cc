@@ -0,0 +1,216 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description: 
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'SLAC Firmware Standard Library', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#include <xvcInterleave.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_AVX2_KERNELS
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HAVE_NEON_KERNELS
+#endif
+
+void
+JtagInterleaver::generic(uint8_t *dst, const uint8_t *tms, const uint8_t *tdi, unsigned long nwords, unsigned wsz)
+{
+	while ( nwords-- > 0 ) {
+		memcpy( dst, tms, wsz );
+		dst += wsz;
+		tms += wsz;
+		memcpy( dst, tdi, wsz );
+		dst += wsz;
+		tdi += wsz;
+	}
+}
+
+// constant-size memcpy is turned into plain loads and stores by the compiler
+template <unsigned W> static void
+ilvScalar(uint8_t *dst, const uint8_t *tms, const uint8_t *tdi, unsigned long nwords, unsigned)
+{
+	while ( nwords-- > 0 ) {
+		memcpy( dst,     tms, W );
+		memcpy( dst + W, tdi, W );
+		dst += 2*W;
+		tms += W;
+		tdi += W;
+	}
+}
+
+#if defined(__SSE2__)
+// 16 bytes of TMS and TDI at a time
+template <unsigned W> static void
+ilvSse2(uint8_t *dst, const uint8_t *tms, const uint8_t *tdi, unsigned long nwords, unsigned wsz)
+{
+const unsigned long WPV = 16/W;
+
+	for ( ; nwords >= WPV; nwords -= WPV ) {
+		__m128i a = _mm_loadu_si128( (const __m128i*)tms );
+		__m128i b = _mm_loadu_si128( (const __m128i*)tdi );
+		__m128i l, h;
+		if ( 4 == W ) {
+			l = _mm_unpacklo_epi32( a, b );
+			h = _mm_unpackhi_epi32( a, b );
+		} else {
+			l = _mm_unpacklo_epi64( a, b );
+			h = _mm_unpackhi_epi64( a, b );
+		}
+		_mm_storeu_si128( (__m128i*)(dst +  0), l );
+		_mm_storeu_si128( (__m128i*)(dst + 16), h );
+		dst += 32;
+		tms += 16;
+		tdi += 16;
+	}
+	ilvScalar<W>( dst, tms, tdi, nwords, wsz );
+}
+#endif
+
+#ifdef HAVE_AVX2_KERNELS
+// 32 bytes of TMS and TDI at a time; unpack works within 128-bit
+// lanes so the lanes have to be reassembled.
+template <unsigned W> __attribute__((target("avx2"))) static void
+ilvAvx2(uint8_t *dst, const uint8_t *tms, const uint8_t *tdi, unsigned long nwords, unsigned wsz)
+{
+const unsigned long WPV = 32/W;
+
+	for ( ; nwords >= WPV; nwords -= WPV ) {
+		__m256i a = _mm256_loadu_si256( (const __m256i*)tms );
+		__m256i b = _mm256_loadu_si256( (const __m256i*)tdi );
+		__m256i l, h;
+		if ( 4 == W ) {
+			l = _mm256_unpacklo_epi32( a, b );
+			h = _mm256_unpackhi_epi32( a, b );
+		} else if ( 8 == W ) {
+			l = _mm256_unpacklo_epi64( a, b );
+			h = _mm256_unpackhi_epi64( a, b );
+		} else {
+			l = a;
+			h = b;
+		}
+		_mm256_storeu_si256( (__m256i*)(dst +  0), _mm256_permute2x128_si256( l, h, 0x20 ) );
+		_mm256_storeu_si256( (__m256i*)(dst + 32), _mm256_permute2x128_si256( l, h, 0x31 ) );
+		dst += 64;
+		tms += 32;
+		tdi += 32;
+	}
+	ilvScalar<W>( dst, tms, tdi, nwords, wsz );
+}
+#endif
+
+#ifdef HAVE_NEON_KERNELS
+// 16 bytes of TMS and TDI at a time
+template <unsigned W> static void
+ilvNeon(uint8_t *dst, const uint8_t *tms, const uint8_t *tdi, unsigned long nwords, unsigned wsz)
+{
+const unsigned long WPV = 16/W;
+
+	for ( ; nwords >= WPV; nwords -= WPV ) {
+		uint8x16_t a = vld1q_u8( tms );
+		uint8x16_t b = vld1q_u8( tdi );
+		if ( 4 == W ) {
+			uint32x4x2_t v;
+			v.val[0] = vreinterpretq_u32_u8( a );
+			v.val[1] = vreinterpretq_u32_u8( b );
+			vst2q_u32( (uint32_t*)dst, v );
+		} else if ( 8 == W ) {
+			vst1q_u8( dst +  0, vcombine_u8( vget_low_u8 ( a ), vget_low_u8 ( b ) ) );
+			vst1q_u8( dst + 16, vcombine_u8( vget_high_u8( a ), vget_high_u8( b ) ) );
+		} else {
+			vst1q_u8( dst +  0, a );
+			vst1q_u8( dst + 16, b );
+		}
+		dst += 32;
+		tms += 16;
+		tdi += 16;
+	}
+	ilvScalar<W>( dst, tms, tdi, nwords, wsz );
+}
+#endif
+
+JtagInterleaver::Kernel
+JtagInterleaver::getScalar(unsigned wsz, const char **name)
+{
+Kernel      k;
+const char *n;
+
+	switch ( wsz ) {
+		case  4: k = ilvScalar< 4>; n = "scalar/4";  break;
+		case  8: k = ilvScalar< 8>; n = "scalar/8";  break;
+		case 16: k = ilvScalar<16>; n = "scalar/16"; break;
+		default: k = generic;       n = "generic";   break;
+	}
+	if ( name ) {
+		*name = n;
+	}
+	return k;
+}
+
+JtagInterleaver::Kernel
+JtagInterleaver::get(unsigned wsz, const char **name)
+{
+Kernel      k = 0;
+const char *n = 0;
+
+	if ( 4 != wsz && 8 != wsz && 16 != wsz ) {
+		return getScalar( wsz, name );
+	}
+
+#ifdef HAVE_AVX2_KERNELS
+	if ( __builtin_cpu_supports( "avx2" ) ) {
+		switch ( wsz ) {
+			case  4: k = ilvAvx2< 4>; n = "avx2/4";  break;
+			case  8: k = ilvAvx2< 8>; n = "avx2/8";  break;
+			default: k = ilvAvx2<16>; n = "avx2/16"; break;
+		}
+	}
+#endif
+
+#if defined(__SSE2__)
+	if ( ! k ) {
+		switch ( wsz ) {
+			case  4: k = ilvSse2< 4>; n = "sse2/4"; break;
+			case  8: k = ilvSse2< 8>; n = "sse2/8"; break;
+			default: break; // 16: plain 16-byte loads/stores are just as good
+		}
+	}
+#endif
+
+#ifdef HAVE_NEON_KERNELS
+	if ( ! k ) {
+		switch ( wsz ) {
+			case  4: k = ilvNeon< 4>; n = "neon/4";  break;
+			case  8: k = ilvNeon< 8>; n = "neon/8";  break;
+			default: k = ilvNeon<16>; n = "neon/16"; break;
+		}
+	}
+#endif
+
+	if ( ! k ) {
+		return getScalar( wsz, name );
+	}
+
+	if ( name ) {
+		*name = n;
+	}
+	return k;
+}
@@ -0,0 +1,45 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description: 
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'SLAC Firmware Standard Library', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#ifndef XVC_INTERLEAVE_H
+#define XVC_INTERLEAVE_H
+
+#include <stdint.h>
+
+// Kernels which merge the TMS and TDI vectors into the AxisToJtag
+// stream format, i.e., TMS_WORD, TDI_WORD, TMS_WORD, TDI_WORD, ...
+//
+// There are specialized versions for the common word sizes (4, 8, 16)
+// which use SIMD instructions where available; the best one is picked
+// at run-time (once the word size is known from the target).
+class JtagInterleaver {
+public:
+	// interleave 'nwords' whole words of size 'wsz' from 'tms' and 'tdi'
+	// into 'dst' (which must hold 2*nwords*wsz bytes).
+	typedef void (*Kernel)(uint8_t *dst, const uint8_t *tms, const uint8_t *tdi, unsigned long nwords, unsigned wsz);
+
+	// best kernel for word size 'wsz'; the kernel name is
+	// stored in '*name' (if non-NULL).
+	static Kernel get(unsigned wsz, const char **name = 0);
+
+	// plain C++ kernel (not using SIMD extensions)
+	static Kernel getScalar(unsigned wsz, const char **name = 0);
+
+	// generic kernel for any word size (a memcpy per word)
+	static void   generic(uint8_t *dst, const uint8_t *tms, const uint8_t *tdi, unsigned long nwords, unsigned wsz);
+};
+
+#endif
@@ -0,0 +1,287 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#include <xvcMetrics.h>
+#include <xvcDriver.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/signalfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+XvcMetric::XvcMetric(const char *name, const char *help)
+: name_( name ),
+  help_( help ),
+  next_( 0    )
+{
+	XvcMetrics::get()->add( this );
+}
+
+void
+XvcMetric::printHdr(FILE *f, const char *type)
+{
+	fprintf(f, "# HELP %s %s\n", name_, help_);
+	fprintf(f, "# TYPE %s %s\n", name_, type );
+}
+
+XvcCounter::XvcCounter(const char *name, const char *help)
+: XvcMetric( name, help ),
+  val_     ( 0          )
+{
+}
+
+void
+XvcCounter::print(FILE *f)
+{
+	printHdr( f, "counter" );
+	fprintf(f, "%s %llu\n", getName(), (unsigned long long)get());
+}
+
+XvcHistogram::XvcHistogram(const char *name, const char *help, double scale, unsigned lg0)
+: XvcMetric( name, help ),
+  scale_   ( scale      ),
+  lg0_     ( lg0        ),
+  sum_     ( 0          ),
+  cnt_     ( 0          )
+{
+unsigned i;
+	for ( i = 0; i <= NBUCKETS; i++ ) {
+		bkt_[i] = 0;
+	}
+}
+
+void
+XvcHistogram::observe(uint64_t v)
+{
+unsigned i;
+
+	// index of the smallest power of two >= v
+	i = v <= 1 ? 0 : 64 - __builtin_clzll( v - 1 );
+	i = i <= lg0_ ? 0 : i - lg0_;
+	if ( i > NBUCKETS ) {
+		i = NBUCKETS;
+	}
+	bkt_[i].fetch_add( 1, std::memory_order_relaxed );
+	sum_.fetch_add   ( v, std::memory_order_relaxed );
+	cnt_.fetch_add   ( 1, std::memory_order_relaxed );
+}
+
+void
+XvcHistogram::print(FILE *f)
+{
+unsigned long long cum = 0;
+unsigned           i;
+
+	printHdr( f, "histogram" );
+	// prometheus buckets are cumulative
+	for ( i = 0; i < NBUCKETS; i++ ) {
+		cum += bkt_[i].load( std::memory_order_relaxed );
+		fprintf(f, "%s_bucket{le=\"%g\"} %llu\n", getName(), scale_ * (double)(1ULL << (lg0_ + i)), cum);
+	}
+	cum += bkt_[NBUCKETS].load( std::memory_order_relaxed );
+	fprintf(f, "%s_bucket{le=\"+Inf\"} %llu\n", getName(), cum);
+	fprintf(f, "%s_sum %g\n",     getName(), scale_ * (double)sum_.load( std::memory_order_relaxed ));
+	fprintf(f, "%s_count %llu\n", getName(), (unsigned long long)getCount());
+}
+
+XvcTimed::~XvcTimed()
+{
+struct timespec now;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	h_->observe( (now.tv_sec - t0_.tv_sec)*1000000000ULL + now.tv_nsec - t0_.tv_nsec );
+}
+
+XvcMetrics::XvcMetrics()
+: head_( 0 ),
+  tail_( 0 )
+{
+}
+
+XvcMetrics *
+XvcMetrics::get()
+{
+static XvcMetrics theRegistry;
+	return &theRegistry;
+}
+
+void
+XvcMetrics::add(XvcMetric *m)
+{
+	// metrics are created during static initialization (or while loading
+	// a driver) before any reader exists.
+	if ( tail_ ) {
+		tail_->next_ = m;
+	} else {
+		head_        = m;
+	}
+	tail_ = m;
+}
+
+void
+XvcMetrics::print(FILE *f)
+{
+XvcMetric *m;
+
+	for ( m = head_; m; m = m->next_ ) {
+		m->print( f );
+	}
+	fflush( f );
+}
+
+struct MetricsCtx {
+	int sigFd;
+	int lsd;
+};
+
+static void
+serve(int sd)
+{
+struct pollfd pfd;
+char          buf[1024];
+int           got;
+FILE         *f;
+
+	// consume the (HTTP) request, if any; we serve the metrics
+	// for whatever is asked for
+	pfd.fd     = sd;
+	pfd.events = POLLIN;
+	while ( poll( &pfd, 1, 200 ) > 0 ) {
+		if ( (got = read( sd, buf, sizeof(buf) - 1 )) <= 0 ) {
+			break;
+		}
+		buf[got] = 0;
+		if ( strstr( buf, "\r\n\r\n" ) || strstr( buf, "\n\n" ) ) {
+			break;
+		}
+	}
+
+	if ( ! (f = fdopen( sd, "w" )) ) {
+		close( sd );
+		return;
+	}
+	fprintf(f, "HTTP/1.0 200 OK\r\n");
+	fprintf(f, "Content-Type: text/plain; version=0.0.4\r\n");
+	fprintf(f, "Connection: close\r\n\r\n");
+	XvcMetrics::get()->print( f );
+	fclose( f );
+}
+
+static void *
+metricsThread(void *arg)
+{
+MetricsCtx              *ctx = (MetricsCtx*)arg;
+struct pollfd            pfd[2];
+struct signalfd_siginfo  si;
+unsigned                 n;
+int                      sd;
+
+	pfd[0].fd     = ctx->sigFd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd     = ctx->lsd;
+	pfd[1].events = POLLIN;
+
+	n = ctx->lsd >= 0 ? 2 : 1;
+
+	while ( 1 ) {
+		if ( poll( pfd, n, -1 ) < 0 ) {
+			if ( EINTR == errno ) {
+				continue;
+			}
+			perror("metrics thread: poll failed");
+			break;
+		}
+		if ( (pfd[0].revents & POLLIN) && sizeof(si) == read( ctx->sigFd, &si, sizeof(si) ) ) {
+			XvcMetrics::get()->print( stderr );
+		}
+		if ( n > 1 && (pfd[1].revents & POLLIN) ) {
+			if ( (sd = accept( ctx->lsd, 0, 0 )) >= 0 ) {
+				serve( sd );
+			}
+		}
+	}
+	return 0;
+}
+
+void
+XvcMetrics::start(const char *exportAt)
+{
+static MetricsCtx  ctx;
+sigset_t           sigs;
+pthread_t          tid;
+struct sockaddr_in sin;
+struct sockaddr_un sun;
+unsigned           port;
+int                opt;
+
+	sigemptyset( &sigs );
+	sigaddset  ( &sigs, SIGUSR1 );
+	if ( pthread_sigmask( SIG_BLOCK, &sigs, 0 ) ) {
+		throw std::runtime_error("XvcMetrics: unable to block SIGUSR1");
+	}
+	if ( (ctx.sigFd = signalfd( -1, &sigs, SFD_CLOEXEC )) < 0 ) {
+		throw SysErr("XvcMetrics: unable to create signalfd");
+	}
+
+	ctx.lsd = -1;
+
+	if ( exportAt ) {
+		if ( strchr( exportAt, '/' ) ) {
+			if ( strlen( exportAt ) >= sizeof(sun.sun_path) ) {
+				throw std::runtime_error("XvcMetrics: UNIX socket path too long");
+			}
+			if ( (ctx.lsd = socket( AF_UNIX, SOCK_STREAM, 0 )) < 0 ) {
+				throw SysErr("XvcMetrics: unable to create socket");
+			}
+			memset( &sun, 0, sizeof(sun) );
+			sun.sun_family = AF_UNIX;
+			strcpy( sun.sun_path, exportAt );
+			// remove a stale socket
+			unlink( exportAt );
+			if ( bind( ctx.lsd, (struct sockaddr*)&sun, sizeof(sun) ) ) {
+				throw SysErr("XvcMetrics: unable to bind UNIX socket");
+			}
+		} else {
+			if ( 1 != sscanf( exportAt, "%i", &port ) || port > 65535 ) {
+				throw std::runtime_error("XvcMetrics: invalid export port (need <port> or </path>)");
+			}
+			if ( (ctx.lsd = socket( AF_INET, SOCK_STREAM, 0 )) < 0 ) {
+				throw SysErr("XvcMetrics: unable to create socket");
+			}
+			opt = 1;
+			setsockopt( ctx.lsd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt) );
+			memset( &sin, 0, sizeof(sin) );
+			sin.sin_family      = AF_INET;
+			sin.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+			sin.sin_port        = htons( (unsigned short)port );
+			if ( bind( ctx.lsd, (struct sockaddr*)&sin, sizeof(sin) ) ) {
+				throw SysErr("XvcMetrics: unable to bind TCP socket");
+			}
+		}
+		if ( listen( ctx.lsd, 4 ) ) {
+			throw SysErr("XvcMetrics: unable to listen");
+		}
+	}
+
+	if ( pthread_create( &tid, 0, metricsThread, &ctx ) ) {
+		throw SysErr("XvcMetrics: unable to launch thread");
+	}
+	pthread_detach( tid );
+}
@@ -0,0 +1,146 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#ifndef XVC_METRICS_H
+#define XVC_METRICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <atomic>
+
+// Simple metrics (counters and histograms) which are cheap enough
+// to be always on. Metrics are usually static objects which register
+// themselves with the (global) registry. They may be updated from
+// any thread.
+//
+// The registry can print all metrics in the prometheus text format;
+// this is done
+//  - on SIGUSR1 (to stderr)
+//  - for every connection to the (optional) export socket.
+
+class XvcMetric {
+private:
+	const char *name_;
+	const char *help_;
+	XvcMetric  *next_;
+
+	XvcMetric(const XvcMetric &);
+	XvcMetric & operator=(const XvcMetric &);
+
+	friend class XvcMetrics;
+
+protected:
+	virtual void printHdr(FILE *f, const char *type);
+
+public:
+	// 'name' and 'help' must be static strings
+	XvcMetric(const char *name, const char *help);
+
+	virtual const char *getName() { return name_; }
+
+	// print in prometheus text format
+	virtual void print(FILE *f) = 0;
+
+	virtual ~XvcMetric() {}
+};
+
+class XvcCounter : public XvcMetric {
+private:
+	std::atomic<uint64_t> val_;
+public:
+	XvcCounter(const char *name, const char *help);
+
+	void inc(uint64_t n = 1)
+	{
+		val_.fetch_add( n, std::memory_order_relaxed );
+	}
+
+	uint64_t get()
+	{
+		return val_.load( std::memory_order_relaxed );
+	}
+
+	virtual void print(FILE *f);
+};
+
+// Histogram with logarithmic (power of two) buckets. Observed values
+// are integers and converted to the exported unit by multiplying with
+// 'scale' (e.g., 1.0E-9 for latencies measured in ns and exported
+// in seconds, as prometheus suggests). Bucket 'i' counts values
+// <= 2^(lg0+i).
+class XvcHistogram : public XvcMetric {
+public:
+	static const unsigned NBUCKETS = 24;
+private:
+	double                scale_;
+	unsigned              lg0_;
+	std::atomic<uint64_t> bkt_[NBUCKETS + 1]; // last one is '+Inf'
+	std::atomic<uint64_t> sum_;
+	std::atomic<uint64_t> cnt_;
+public:
+	XvcHistogram(const char *name, const char *help, double scale = 1.0, unsigned lg0 = 0);
+
+	void observe(uint64_t v);
+
+	uint64_t getCount()
+	{
+		return cnt_.load( std::memory_order_relaxed );
+	}
+
+	virtual void print(FILE *f);
+};
+
+// Record the time (in ns) spent in a scope into a histogram
+class XvcTimed {
+private:
+	XvcHistogram   *h_;
+	struct timespec t0_;
+public:
+	XvcTimed(XvcHistogram *h)
+	: h_( h )
+	{
+		clock_gettime( CLOCK_MONOTONIC, &t0_ );
+	}
+
+	~XvcTimed();
+};
+
+class XvcMetrics {
+private:
+	XvcMetric      *head_;
+	XvcMetric      *tail_;
+
+	XvcMetrics();
+
+public:
+	static XvcMetrics *get();
+
+	virtual void add(XvcMetric *m);
+
+	// print all metrics (prometheus text format)
+	virtual void print(FILE *f);
+
+	// Start a thread which dumps all metrics on SIGUSR1 and (if 'exportAt'
+	// is not NULL) serves them on a socket. 'exportAt' is either a TCP
+	// port number (bound to the loopback interface) or the path of a
+	// UNIX socket.
+	// NOTE: must be called before any other thread is created (SIGUSR1
+	//       must be blocked in all threads).
+	static void start(const char *exportAt);
+};
+
+#endif
@@ -0,0 +1,247 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#include <xvcPipeline.h>
+#include <xvcMetrics.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <sched.h>
+
+static XvcCounter nWakeups("xvc_pipe_wakeups_total", "Number of times a pipeline stage had to be woken up");
+
+XvcWakeup::XvcWakeup()
+: asleep_( false )
+{
+	if ( (fd_ = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC )) < 0 ) {
+		throw SysErr("XvcWakeup: unable to create eventfd");
+	}
+}
+
+XvcWakeup::~XvcWakeup()
+{
+	::close( fd_ );
+}
+
+void
+XvcWakeup::sleep()
+{
+	asleep_.store( true, std::memory_order_relaxed );
+	// the consumer's subsequent check of its queue must not be
+	// reordered before the store (pairs with 'notify()')
+	std::atomic_thread_fence( std::memory_order_seq_cst );
+}
+
+void
+XvcWakeup::wait()
+{
+struct pollfd p;
+
+	p.fd     = fd_;
+	p.events = POLLIN;
+	while ( poll( &p, 1, -1 ) < 0 && EINTR == errno )
+		;
+}
+
+void
+XvcWakeup::awake()
+{
+uint64_t v;
+
+	// if the producer cleared the flag then it notified us (or is about
+	// to do so; the spurious wakeup this may cause later is harmless).
+	if ( ! asleep_.exchange( false ) ) {
+		if ( read( fd_, &v, sizeof(v) ) < 0 ) {
+			/* EAGAIN */
+		}
+	}
+}
+
+void
+XvcWakeup::notify()
+{
+uint64_t v = 1;
+
+	std::atomic_thread_fence( std::memory_order_seq_cst );
+	if ( asleep_.load( std::memory_order_relaxed ) && asleep_.exchange( false ) ) {
+		nWakeups.inc();
+		if ( write( fd_, &v, sizeof(v) ) < 0 ) {
+			/* counter can't overflow */
+		}
+	}
+}
+
+XvcPipeline::XvcPipeline(JtagDriver *drv, int cpu)
+: drv_        ( drv   ),
+  outstanding_( 0     ),
+  maxInFlight_( 1     ),
+  failed_     ( false )
+{
+	if ( pthread_create( &tid_, 0, threadFunc, this ) ) {
+		throw SysErr("XvcPipeline: unable to launch driver thread");
+	}
+	pthread_detach( tid_ );
+	pin( tid_, cpu );
+}
+
+void
+XvcPipeline::pin(pthread_t t, int cpu)
+{
+cpu_set_t s;
+
+	if ( cpu < 0 ) {
+		return;
+	}
+	CPU_ZERO( &s );
+	CPU_SET( cpu, &s );
+	if ( pthread_setaffinity_np( t, sizeof(s), &s ) ) {
+		throw std::runtime_error("Unable to pin thread to CPU");
+	}
+}
+
+void *
+XvcPipeline::threadFunc(void *arg)
+{
+	((XvcPipeline*)arg)->run();
+	return 0;
+}
+
+// complete the oldest chunk in flight and pass it back
+void
+XvcPipeline::complete()
+{
+	drv_->completeVectors();
+	cmp_.push( inFlight_.front() );
+	inFlight_.pop_front();
+	cmpWake_.notify();
+}
+
+void
+XvcPipeline::failAll(const char *why)
+{
+	if ( ! failed_ ) {
+		err_    = why;
+		failed_ = true;
+	}
+	while ( ! inFlight_.empty() ) {
+		inFlight_.front().failed_ = true;
+		cmp_.push( inFlight_.front() );
+		inFlight_.pop_front();
+	}
+	cmpWake_.notify();
+}
+
+void
+XvcPipeline::run()
+{
+XvcJob j;
+
+	while ( 1 ) {
+		if ( ! req_.pop( &j ) ) {
+			if ( ! inFlight_.empty() ) {
+				// nothing new to submit; don't leave the chunks in flight
+				// waiting but look for more work after every completion
+				try {
+					complete();
+				} catch ( std::runtime_error &e ) {
+					failAll( e.what() );
+				}
+				continue;
+			}
+			reqWake_.sleep();
+			if ( req_.empty() ) {
+				reqWake_.wait();
+			}
+			reqWake_.awake();
+			continue;
+		}
+
+		if ( j.first_ ) {
+			failed_      = false;
+			maxInFlight_ = drv_->getMaxInFlight();
+		}
+
+		if ( failed_ ) {
+			// the shift is lost anyways
+			j.failed_ = true;
+			cmp_.push( j );
+			cmpWake_.notify();
+			continue;
+		}
+
+		// 'j' must be passed back even if the driver fails to submit it
+		inFlight_.push_back( j );
+		try {
+			drv_->submitVectors( j.bits_, j.tms_, j.tdi_, j.tdo_ );
+			while ( ! inFlight_.empty() && ( inFlight_.size() >= maxInFlight_ || j.last_ ) ) {
+				complete();
+			}
+		} catch ( std::runtime_error &e ) {
+			failAll( e.what() );
+		}
+	}
+}
+
+void
+XvcPipeline::submit(const XvcJob &j)
+{
+	// never full; the caller checks 'full()'
+	req_.push( j );
+	outstanding_++;
+	reqWake_.notify();
+}
+
+bool
+XvcPipeline::pop(XvcJob *j)
+{
+	if ( ! cmp_.pop( j ) ) {
+		return false;
+	}
+	outstanding_--;
+	return true;
+}
+
+void
+XvcPipeline::drain()
+{
+XvcJob j;
+
+	while ( outstanding_ > 0 ) {
+		cmpWake_.sleep();
+		if ( cmp_.empty() ) {
+			cmpWake_.wait();
+		}
+		cmpWake_.awake();
+		while ( pop( &j ) )
+			;
+	}
+}
+
+bool
+XvcPipeline::sleep()
+{
+	cmpWake_.sleep();
+	if ( ! cmp_.empty() ) {
+		cmpWake_.awake();
+		return false;
+	}
+	return true;
+}
+
+void
+XvcPipeline::awake()
+{
+	cmpWake_.awake();
+}
@@ -0,0 +1,201 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#ifndef XVC_PIPELINE_H
+#define XVC_PIPELINE_H
+
+#include <xvcDriver.h>
+#include <atomic>
+#include <deque>
+#include <pthread.h>
+
+// Lock-free single-producer/single-consumer ring of 2^LD elements
+template <typename T, unsigned LD> class XvcSpscQueue {
+public:
+	static const unsigned long SIZE = 1UL << LD;
+
+private:
+	T                                      buf_[SIZE];
+	// head and tail live in separate cache lines
+	alignas(64) std::atomic<unsigned long> head_; // written by the producer
+	alignas(64) std::atomic<unsigned long> tail_; // written by the consumer
+
+	XvcSpscQueue(const XvcSpscQueue &);
+	XvcSpscQueue & operator=(const XvcSpscQueue &);
+
+public:
+	XvcSpscQueue()
+	: head_( 0 ),
+	  tail_( 0 )
+	{
+	}
+
+	// producer; returns false if the ring is full
+	bool push(const T &v)
+	{
+	unsigned long h = head_.load( std::memory_order_relaxed );
+
+		if ( h - tail_.load( std::memory_order_acquire ) >= SIZE ) {
+			return false;
+		}
+		buf_[ h & (SIZE - 1) ] = v;
+		head_.store( h + 1, std::memory_order_release );
+		return true;
+	}
+
+	// consumer; returns false if the ring is empty
+	bool pop(T *v)
+	{
+	unsigned long t = tail_.load( std::memory_order_relaxed );
+
+		if ( t == head_.load( std::memory_order_acquire ) ) {
+			return false;
+		}
+		*v = buf_[ t & (SIZE - 1) ];
+		tail_.store( t + 1, std::memory_order_release );
+		return true;
+	}
+
+	bool empty()
+	{
+		return tail_.load( std::memory_order_acquire ) == head_.load( std::memory_order_acquire );
+	}
+};
+
+// Wake up the consumer of a queue which sleeps (on an eventfd) while the
+// queue is empty. The producer only issues a system call if the consumer
+// is actually asleep.
+//
+// Consumer:  sleep(); if ( queue empty ) wait(); awake();
+// Producer:  push(); notify();
+class XvcWakeup {
+private:
+	int               fd_;
+	std::atomic<bool> asleep_;
+
+	XvcWakeup(const XvcWakeup &);
+	XvcWakeup & operator=(const XvcWakeup &);
+
+public:
+	XvcWakeup();
+
+	// the eventfd becomes readable when the consumer is notified
+	virtual int  getFd() { return fd_; }
+
+	// consumer announces that it is going to sleep; it must check
+	// its queue once more before actually waiting.
+	virtual void sleep();
+
+	// block until notified
+	virtual void wait();
+
+	// consumer is back at work; consume a pending notification
+	virtual void awake();
+
+	virtual void notify();
+
+	virtual ~XvcWakeup();
+};
+
+// A (chunk of a) shift handed to the driver thread and back
+struct XvcJob {
+	unsigned long  bits_;
+	uint8_t       *tms_;
+	uint8_t       *tdi_;
+	uint8_t       *tdo_;
+	bool           first_; // first chunk of a shift
+	bool           last_;  // last chunk of a shift
+	bool           failed_;
+};
+
+// Two-stage pipeline: the I/O thread (running the XvcServer) parses XVC
+// commands and submits the chunks of a shift to a driver thread which
+// executes them (with up to 'getMaxInFlight()' chunks in flight) and
+// passes them back once completed. Thus, TCP and the target transfers
+// proceed in parallel on different cores.
+//
+// While the driver thread has chunks outstanding the I/O thread must not
+// use the driver; in between it may (e.g., for 'getinfo:' or 'settck:').
+class XvcPipeline {
+public:
+	typedef XvcSpscQueue<XvcJob, 8> Queue;
+
+private:
+	JtagDriver       *drv_;
+	Queue             req_;
+	Queue             cmp_;
+	XvcWakeup         reqWake_;
+	XvcWakeup         cmpWake_;
+	// chunks submitted but not yet popped (I/O thread)
+	unsigned long     outstanding_;
+	// driver thread
+	std::deque<XvcJob> inFlight_;
+	unsigned          maxInFlight_;
+	bool              failed_;
+	std::string       err_;
+	pthread_t         tid_;
+
+	XvcPipeline(const XvcPipeline &);
+	XvcPipeline & operator=(const XvcPipeline &);
+
+	static void      *threadFunc(void *arg);
+
+	virtual void      complete();
+	virtual void      failAll(const char *why);
+
+public:
+	// launch the driver thread; pinned to 'cpu' unless negative.
+	XvcPipeline(JtagDriver *drv, int cpu = -1);
+
+	// pin thread 't' to 'cpu' (nothing happens if 'cpu' is negative)
+	static void       pin(pthread_t t, int cpu);
+
+	// driver thread
+	virtual void      run();
+
+	// I/O thread interface
+
+	// may another chunk be submitted?
+	virtual bool      full() { return outstanding_ >= Queue::SIZE; }
+
+	virtual unsigned long getOutstanding() { return outstanding_; }
+
+	virtual void      submit(const XvcJob &j);
+
+	// fetch a completed chunk; returns false if there is none
+	virtual bool      pop(XvcJob *j);
+
+	// block until all outstanding chunks are completed (and discarded)
+	virtual void      drain();
+
+	// reason why a chunk (and all subsequent chunks of the same shift)
+	// failed; valid once a failed chunk has been popped
+	virtual const char *getError() { return err_.c_str(); }
+
+	// the eventfd which becomes readable when chunks complete (while
+	// the I/O thread is asleep)
+	virtual int       getFd() { return cmpWake_.getFd(); }
+
+	// I/O thread is about to block (e.g., in epoll_wait); returns false
+	// if there are completed chunks already (and the thread must not block)
+	virtual bool      sleep();
+
+	virtual void      awake();
+
+	virtual ~XvcPipeline() {}
+};
+
+#endif
@@ -0,0 +1,185 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#include <xvcProfile.h>
+
+static XvcCounter   nIdle    ("xvc_tck_idle_cycles_total",     "TCK cycles in Test-Logic-Reset or Run-Test/Idle");
+static XvcCounter   nNav     ("xvc_tck_nav_cycles_total",      "TCK cycles navigating the TAP (Select, Capture, Exit, Pause, Update)");
+static XvcCounter   nShiftIR ("xvc_tck_ir_shift_cycles_total", "TCK cycles in Shift-IR");
+static XvcCounter   nShiftDR ("xvc_tck_dr_shift_cycles_total", "TCK cycles in Shift-DR");
+static XvcHistogram hDrLen   ("xvc_dr_scan_bits",              "Length of DR scans");
+static XvcHistogram hMsgBits ("xvc_msg_bits",                  "Number of bits per XVC 'shift:' message");
+static XvcIrCounter nDrScans ("xvc_dr_scans_total",            "Number of DR scans by instruction");
+static XvcIrCounter nDrBits  ("xvc_dr_scan_bits_total",        "Number of DR bits scanned by instruction");
+
+// in the order of the cycle classes
+static XvcCounter  *cycleCounters[] = { &nIdle, &nNav, &nShiftIR, &nShiftDR };
+
+static const char  *cycleNames[]    = {
+	"idle (TLR/RTI)",
+	"TMS navigation",
+	"IR scans",
+	"DR scans",
+};
+
+XvcIrCounter::XvcIrCounter(const char *name, const char *help)
+: XvcMetric( name, help )
+{
+	pthread_mutex_init( &mtx_, 0 );
+}
+
+void
+XvcIrCounter::add(JtagRegType ir, uint64_t n)
+{
+	pthread_mutex_lock( &mtx_ );
+	vals_[ ir ] += n;
+	pthread_mutex_unlock( &mtx_ );
+}
+
+void
+XvcIrCounter::print(FILE *f)
+{
+std::map<JtagRegType, uint64_t>::iterator it;
+
+	printHdr( f, "counter" );
+	pthread_mutex_lock( &mtx_ );
+	for ( it = vals_.begin(); it != vals_.end(); ++it ) {
+		fprintf(f, "%s{ir=\"0x%llx\"} %llu\n", getName(), it->first, (unsigned long long)it->second);
+	}
+	pthread_mutex_unlock( &mtx_ );
+}
+
+XvcProfile::XvcProfile()
+: msgs_   ( 0 ),
+  msgBits_( 0 ),
+  msgMax_ ( 0 )
+{
+unsigned i;
+
+	irScans_.scans_ = 0;
+	irScans_.bits_  = 0;
+	for ( i = 0; i < NBUCKETS; i++ ) {
+		drLen_[i]  = 0;
+		msgLen_[i] = 0;
+	}
+	for ( i = 0; i < NUM_CLASSES; i++ ) {
+		published_[i] = 0;
+	}
+}
+
+// index of the smallest power of two >= v
+unsigned
+XvcProfile::bucket(uint64_t v)
+{
+unsigned i = v <= 1 ? 0 : 64 - __builtin_clzll( v - 1 );
+
+	return i < NBUCKETS ? i : NBUCKETS - 1;
+}
+
+void
+XvcProfile::handleScan(JtagDumpCtx *context, bool ir)
+{
+ScanStats  *s;
+unsigned    len;
+JtagRegType irv;
+
+	if ( ir ) {
+		irScans_.scans_++;
+		irScans_.bits_ += context->getIRLen();
+		return;
+	}
+	len    = context->getDRLen();
+	irv    = context->getIRo();
+	s      = &drScans_[ irv ];
+	s->scans_++;
+	s->bits_ += len;
+	drLen_[ bucket( len ) ]++;
+
+	hDrLen.observe( len );
+	nDrScans.add( irv, 1   );
+	nDrBits.add ( irv, len );
+}
+
+void
+XvcProfile::message(unsigned long bits)
+{
+unsigned i;
+
+	msgs_++;
+	msgBits_ += bits;
+	if ( bits > msgMax_ ) {
+		msgMax_ = bits;
+	}
+	msgLen_[ bucket( bits ) ]++;
+	hMsgBits.observe( bits );
+
+	for ( i = 0; i < NUM_CLASSES; i++ ) {
+		if ( cycles_[i] != published_[i] ) {
+			cycleCounters[i]->inc( cycles_[i] - published_[i] );
+			published_[i] = cycles_[i];
+		}
+	}
+}
+
+void
+XvcProfile::printHist(FILE *f, const char *title, uint64_t *h)
+{
+unsigned i, lo, hi;
+
+	for ( lo = 0; lo < NBUCKETS && 0 == h[lo]; lo++ )
+		;
+	for ( hi = NBUCKETS; hi > lo && 0 == h[hi - 1]; hi-- )
+		;
+	if ( lo == hi ) {
+		return;
+	}
+	fprintf(f, "  %s:\n", title);
+	for ( i = lo; i < hi; i++ ) {
+		fprintf(f, "    %s%10llu: %llu\n", i == NBUCKETS - 1 ? ">" : "<=", 1ULL << (i == NBUCKETS - 1 ? i - 1 : i), (unsigned long long)h[i]);
+	}
+}
+
+void
+XvcProfile::print(FILE *f)
+{
+std::map<JtagRegType, ScanStats>::iterator it;
+unsigned long long tot = 0;
+unsigned           i;
+
+	for ( i = 0; i < NUM_CLASSES; i++ ) {
+		tot += cycles_[i];
+	}
+	if ( 0 == tot ) {
+		return;
+	}
+	fprintf(f, "TCK profile: %llu cycles in %llu messages (avg. %.1f, max. %llu bits per message)\n",
+		tot, (unsigned long long)msgs_, msgs_ ? (double)msgBits_/(double)msgs_ : 0.0, (unsigned long long)msgMax_);
+	for ( i = 0; i < NUM_CLASSES; i++ ) {
+		fprintf(f, "  %-16s %14llu %5.1f%%\n", cycleNames[i], cycles_[i], 100.0*(double)cycles_[i]/(double)tot);
+	}
+	fprintf(f, "  IR scans: %llu (%llu bits)\n", (unsigned long long)irScans_.scans_, (unsigned long long)irScans_.bits_);
+	if ( ! drScans_.empty() ) {
+		fprintf(f, "  DR scans by instruction:\n");
+		fprintf(f, "    %-18s %10s %14s %10s\n", "IR", "scans", "bits", "avg. len");
+		for ( it = drScans_.begin(); it != drScans_.end(); ++it ) {
+			fprintf(f, "    0x%-16llx %10llu %14llu %10.1f\n", it->first,
+				(unsigned long long)it->second.scans_, (unsigned long long)it->second.bits_,
+				(double)it->second.bits_/(double)it->second.scans_);
+		}
+	}
+	printHist( f, "DR scan lengths (bits)", drLen_ );
+	printHist( f, "XVC message sizes (bits)", msgLen_ );
+}
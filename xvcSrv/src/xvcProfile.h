@@ -0,0 +1,85 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#ifndef XVC_PROFILE_H
+#define XVC_PROFILE_H
+
+#include <jtagDump.h>
+#include <xvcMetrics.h>
+#include <stdint.h>
+#include <map>
+#include <pthread.h>
+
+// Counter per instruction (IR value); exported with an 'ir' label
+class XvcIrCounter : public XvcMetric {
+private:
+	std::map<JtagRegType, uint64_t> vals_;
+	pthread_mutex_t                 mtx_;
+
+public:
+	XvcIrCounter(const char *name, const char *help);
+
+	void add(JtagRegType ir, uint64_t n);
+
+	virtual void print(FILE *f);
+};
+
+// Profile of the JTAG traffic of a session (i.e., of one XVC connection):
+// where the TCK cycles go (idle, navigation, IR and DR scans), DR scans
+// by instruction, DR lengths and the number of bits per XVC message.
+// The TAP tracker of the server feeds the cycles and scans; the global
+// metrics are updated as the session proceeds.
+class XvcProfile : public JtagProfile {
+public:
+	// log2 buckets
+	static const unsigned NBUCKETS = 24;
+
+	typedef struct {
+		uint64_t scans_;
+		uint64_t bits_;
+	} ScanStats;
+
+private:
+	ScanStats                        irScans_;
+	// DR scans by instruction
+	std::map<JtagRegType, ScanStats> drScans_;
+	uint64_t                         drLen_[NBUCKETS];
+	uint64_t                         msgs_;
+	uint64_t                         msgBits_;
+	uint64_t                         msgMax_;
+	uint64_t                         msgLen_[NBUCKETS];
+	// cycles already added to the global metrics
+	unsigned long long               published_[NUM_CLASSES];
+
+	static unsigned bucket(uint64_t v);
+
+	static void     printHist(FILE *f, const char *title, uint64_t *h);
+
+public:
+	XvcProfile();
+
+	virtual void handleScan(JtagDumpCtx *context, bool ir);
+
+	// an XVC 'shift:' of 'bits' has been processed
+	virtual void message(unsigned long bits);
+
+	// print a summary
+	virtual void print(FILE *f);
+
+	virtual ~XvcProfile() {}
+};
+
+#endif
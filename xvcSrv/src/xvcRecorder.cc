@@ -0,0 +1,278 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#include <xvcRecorder.h>
+#include <xvcDriver.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <time.h>
+
+XvcRecorder *XvcRecorder::theRecorder_ = 0;
+
+static const unsigned long HDRSZ = 64;
+
+static unsigned long
+pad8(unsigned long l)
+{
+	return (l + 7) & ~7UL;
+}
+
+uint64_t
+XvcRecorder::now()
+{
+struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+XvcRecorder::XvcRecorder(const char *path, unsigned long ringSize)
+{
+int             fd;
+void           *m;
+struct timespec t;
+
+	ringSize = pad8( ringSize );
+	mapSz_   = HDRSZ + ringSize;
+
+	if ( (fd = open( path, O_RDWR | O_CREAT | O_TRUNC, 0644 )) < 0 ) {
+		throw SysErr("XvcRecorder: unable to open recording file");
+	}
+	if ( ftruncate( fd, mapSz_ ) ) {
+		close( fd );
+		throw SysErr("XvcRecorder: unable to size recording file");
+	}
+	m = mmap( 0, mapSz_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+	if ( MAP_FAILED == m ) {
+		throw SysErr("XvcRecorder: unable to map recording file");
+	}
+
+	hdr_  = (XvcRecFileHdr*)m;
+	ring_ = (uint8_t*)m + HDRSZ;
+
+	memcpy( hdr_->magic, XVC_REC_MAGIC, sizeof(hdr_->magic) );
+	hdr_->hdrSize  = HDRSZ;
+	hdr_->wrapped  = 0;
+	hdr_->ringSize = ringSize;
+	hdr_->head     = 0;
+	hdr_->tail     = 0;
+	clock_gettime( CLOCK_REALTIME, &t );
+	hdr_->t0Real   = t.tv_sec * 1000000000ULL + t.tv_nsec;
+	hdr_->t0Mono   = now();
+
+	pthread_mutex_init( &mtx_, 0 );
+}
+
+XvcRecorder::~XvcRecorder()
+{
+	munmap( hdr_, mapSz_ );
+	pthread_mutex_destroy( &mtx_ );
+}
+
+void
+XvcRecorder::start(const char *path, unsigned long ringSize)
+{
+	if ( ringSize < 4096 ) {
+		throw std::runtime_error("XvcRecorder: ring size too small");
+	}
+	theRecorder_ = new XvcRecorder( path, ringSize );
+}
+
+// next record at 'pos' (which must be a valid record)
+static uint64_t
+skip(const uint8_t *ring, uint64_t ringSize, uint64_t pos)
+{
+const XvcRecHdr *r = (const XvcRecHdr*)(ring + pos);
+
+	if ( XvcRecorder::PAD == r->type ) {
+		return 0;
+	}
+	pos += sizeof(*r) + pad8( r->len );
+	if ( pos + sizeof(*r) > ringSize ) {
+		// no room for another record; the writer wrapped
+		return 0;
+	}
+	return pos;
+}
+
+// free space up to offset 'lim' by discarding the oldest records
+void
+XvcRecorder::discard(uint64_t lim)
+{
+	if ( ! hdr_->wrapped ) {
+		return;
+	}
+	// 'tail == head' must never happen after writing (couldn't
+	// tell a full from an empty ring); hence '<='
+	while ( hdr_->tail >= hdr_->head && hdr_->tail <= lim ) {
+		hdr_->tail = skip( ring_, hdr_->ringSize, hdr_->tail );
+	}
+}
+
+void
+XvcRecorder::wrap()
+{
+XvcRecHdr *r;
+
+	if ( hdr_->head + sizeof(*r) <= hdr_->ringSize ) {
+		r        = (XvcRecHdr*)(ring_ + hdr_->head);
+		r->len   = 0;
+		r->type  = PAD;
+		r->flags = 0;
+		r->tns   = 0;
+	}
+	hdr_->head    = 0;
+	hdr_->wrapped = 1;
+}
+
+void
+XvcRecorder::record(RecType type, uint64_t tns, const struct iovec *iov, unsigned n)
+{
+XvcRecHdr    *r;
+unsigned long len = 0;
+unsigned long tot;
+unsigned      i;
+uint8_t      *p;
+uint16_t      flags = 0;
+
+	for ( i = 0; i < n; i++ ) {
+		len += iov[i].iov_len;
+	}
+
+	// a record must not be bigger than half the ring; otherwise
+	// it is truncated.
+	if ( sizeof(*r) + pad8( len ) > hdr_->ringSize/2 ) {
+		len   = hdr_->ringSize/2 - sizeof(*r);
+		flags = TRUNCATED;
+	}
+
+	tot = sizeof(*r) + pad8( len );
+
+	pthread_mutex_lock( &mtx_ );
+
+	if ( hdr_->head + tot > hdr_->ringSize ) {
+		// everything between the head and the end of the ring is lost
+		discard( hdr_->ringSize );
+		wrap();
+	}
+
+	discard( hdr_->head + tot );
+
+	r        = (XvcRecHdr*)(ring_ + hdr_->head);
+	r->len   = len;
+	r->type  = type;
+	r->flags = flags;
+	r->tns   = tns;
+
+	p = (uint8_t*)(r + 1);
+	for ( i = 0; i < n && len > 0; i++ ) {
+		unsigned long l = iov[i].iov_len < len ? iov[i].iov_len : len;
+		memcpy( p, iov[i].iov_base, l );
+		p   += l;
+		len -= l;
+	}
+
+	hdr_->head += tot;
+
+	pthread_mutex_unlock( &mtx_ );
+}
+
+void
+XvcRecorder::record(RecType type, uint64_t tns, const void *buf, unsigned long len)
+{
+struct iovec iov;
+
+	iov.iov_base = (void*)buf;
+	iov.iov_len  = len;
+	record( type, tns, &iov, 1 );
+}
+
+XvcRecording::XvcRecording(const char *path)
+{
+int         fd;
+struct stat st;
+void       *m;
+
+	if ( (fd = open( path, O_RDONLY )) < 0 ) {
+		throw SysErr("XvcRecording: unable to open recording file");
+	}
+	if ( fstat( fd, &st ) ) {
+		close( fd );
+		throw SysErr("XvcRecording: unable to stat recording file");
+	}
+	mapSz_ = st.st_size;
+	if ( mapSz_ < HDRSZ ) {
+		close( fd );
+		throw std::runtime_error("XvcRecording: file too small");
+	}
+	m = mmap( 0, mapSz_, PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if ( MAP_FAILED == m ) {
+		throw SysErr("XvcRecording: unable to map recording file");
+	}
+	map_ = (uint8_t*)m;
+
+	// copy the header; the recorder might still be active
+	memcpy( &hdr_, map_, sizeof(hdr_) );
+
+	if (   memcmp( hdr_.magic, XVC_REC_MAGIC, sizeof(hdr_.magic) )
+	    || hdr_.hdrSize + hdr_.ringSize > mapSz_
+	    || hdr_.head > hdr_.ringSize
+	    || hdr_.tail > hdr_.ringSize ) {
+		munmap( map_, mapSz_ );
+		throw std::runtime_error("XvcRecording: not a (valid) recording");
+	}
+	ring_ = map_ + hdr_.hdrSize;
+
+	rewind();
+}
+
+XvcRecording::~XvcRecording()
+{
+	munmap( map_, mapSz_ );
+}
+
+void
+XvcRecording::rewind()
+{
+	pos_  = hdr_.wrapped ? hdr_.tail : 0;
+	done_ = ( pos_ == hdr_.head );
+}
+
+const XvcRecHdr *
+XvcRecording::next()
+{
+const XvcRecHdr *r;
+unsigned long    tot;
+
+	while ( ! done_ ) {
+		if ( pos_ + sizeof(*r) > hdr_.ringSize ) {
+			pos_ = 0;
+		}
+		r = (const XvcRecHdr*)(ring_ + pos_);
+		if ( XvcRecorder::PAD == r->type ) {
+			pos_  = 0;
+			done_ = ( pos_ == hdr_.head );
+			continue;
+		}
+		tot   = sizeof(*r) + pad8( r->len );
+		pos_ += tot;
+		done_ = ( pos_ == hdr_.head );
+		return r;
+	}
+	return 0;
+}
@@ -0,0 +1,132 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#ifndef XVC_RECORDER_H
+#define XVC_RECORDER_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+// Session recorder
+//
+// Records XVC commands, replies and the messages exchanged with the
+// target into a memory-mapped file which is used as a ring buffer;
+// when the ring is full the oldest records are overwritten. Since the
+// file is mapped shared the recording survives a crash of xvcSrv.
+//
+// File layout: a header (XvcRecFileHdr) followed by the ring. Every
+// record starts with a XvcRecHdr; the payload is padded to a multiple
+// of 8 octets.
+
+#define XVC_REC_MAGIC   "XVCREC01"
+
+struct XvcRecFileHdr {
+	char     magic[8];
+	uint32_t hdrSize;   // size of this header (offset of the ring)
+	uint32_t wrapped;   // ring has wrapped at least once
+	uint64_t ringSize;  // size of the ring (octets)
+	uint64_t head;      // offset (into ring) where the next record goes
+	uint64_t tail;      // offset (into ring) of the oldest record
+	uint64_t t0Real;    // CLOCK_REALTIME when the recording was started (ns)
+	uint64_t t0Mono;    // CLOCK_MONOTONIC when the recording was started (ns)
+};
+
+struct XvcRecHdr {
+	uint32_t len;       // payload length (not including padding)
+	uint16_t type;
+	uint16_t flags;
+	uint64_t tns;       // CLOCK_MONOTONIC timestamp (ns)
+};
+
+class XvcRecorder {
+public:
+	typedef enum {
+		PAD      = 0, // filler up to the end of the ring
+		XVC_CMD  = 1, // XVC command as received (timestamp: start of reception)
+		XVC_REP  = 2, // XVC reply
+		TGT_MSG  = 3, // message sent to the target
+		TGT_REP  = 4  // reply received from the target (header + data)
+	} RecType;
+
+	// flags
+	static const uint16_t TRUNCATED = 1; // payload was too big for the ring
+
+private:
+	XvcRecFileHdr    *hdr_;
+	uint8_t          *ring_;
+	unsigned long     mapSz_;
+	pthread_mutex_t   mtx_;
+
+	static XvcRecorder *theRecorder_;
+
+	XvcRecorder(const char *path, unsigned long ringSize);
+
+	XvcRecorder(const XvcRecorder &);
+	XvcRecorder & operator=(const XvcRecorder &);
+
+	void              wrap();
+	void              discard(uint64_t lim);
+
+public:
+	static uint64_t   now();
+
+	// create the global recorder
+	static void       start(const char *path, unsigned long ringSize);
+
+	// NULL if not recording
+	static XvcRecorder *get()
+	{
+		return theRecorder_;
+	}
+
+	// record a message which is gathered from 'n' parts
+	virtual void      record(RecType type, uint64_t tns, const struct iovec *iov, unsigned n);
+
+	virtual void      record(RecType type, uint64_t tns, const void *buf, unsigned long len);
+
+	virtual ~XvcRecorder();
+};
+
+// Read (a copy of) a recording
+class XvcRecording {
+private:
+	uint8_t          *map_;
+	unsigned long     mapSz_;
+	XvcRecFileHdr     hdr_;
+	const uint8_t    *ring_;
+	uint64_t          pos_;
+	bool              done_;
+
+	XvcRecording(const XvcRecording &);
+	XvcRecording & operator=(const XvcRecording &);
+
+public:
+	XvcRecording(const char *path);
+
+	const XvcRecFileHdr *getHdr() { return &hdr_; }
+
+	// start over with the oldest record
+	virtual void      rewind();
+
+	// next record; returns NULL when all records have been read.
+	// The payload follows the header.
+	virtual const XvcRecHdr *next();
+
+	virtual ~XvcRecording();
+};
+
+#endif
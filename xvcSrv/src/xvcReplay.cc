@@ -0,0 +1,209 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#include <xvcReplay.h>
+#include <algorithm>
+#include <time.h>
+
+typedef enum { GETINFO = 0, SETTCK = 1, SHIFT = 2, NCMDS = 3 } CmdType;
+
+static const char *cmdName[NCMDS] = { "getinfo", "settck", "shift" };
+
+struct Stats {
+	vector<uint64_t> replayed;
+	vector<uint64_t> recorded;
+
+	void print(FILE *f, const char *nm);
+};
+
+static double
+pct(vector<uint64_t> &v, double p)
+{
+	return v.size() ? v[ (size_t)(p * (v.size() - 1)) ] / 1000.0 : 0.0;
+}
+
+void
+Stats::print(FILE *f, const char *nm)
+{
+	std::sort( replayed.begin(), replayed.end() );
+	std::sort( recorded.begin(), recorded.end() );
+	fprintf(f, "%-14s %8lu  replayed: %9.1f %9.1f %9.1f %9.1f  recorded: %9.1f %9.1f %9.1f\n",
+		nm, (unsigned long)replayed.size(),
+		pct( replayed, 0.0 ), pct( replayed, 0.5 ), pct( replayed, 0.99 ), pct( replayed, 1.0 ),
+		pct( recorded, 0.5 ), pct( recorded, 0.99 ), pct( recorded, 1.0 ));
+}
+
+XvcReplay::XvcReplay(JtagDriver *drv, const char *path, bool timed, unsigned long maxVecLen)
+: drv_       ( drv       ),
+  rec_       ( path      ),
+  timed_     ( timed     ),
+  maxVecLen_ ( maxVecLen ),
+  supVecLen_ ( 0         )
+{
+	vec_.reserve( 2*maxVecLen_ );
+	tdo_.reserve( maxVecLen_ );
+}
+
+// same splitting as XvcConn but synchronous
+void
+XvcReplay::shift(unsigned long bits)
+{
+unsigned long bytes = (bits + 7)/8;
+unsigned long off, n;
+
+	for ( off = 0; bits > 0; off += n/8, bits -= n ) {
+		n = 8*supVecLen_;
+		if ( bits < n ) {
+			n = bits;
+		}
+		drv_->sendVectors( n, &vec_[0] + off, &vec_[0] + bytes + off, &tdo_[0] + off );
+	}
+}
+
+static void
+sleepUntil(uint64_t tns)
+{
+struct timespec t;
+
+	t.tv_sec  = tns / 1000000000ULL;
+	t.tv_nsec = tns % 1000000000ULL;
+	while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &t, 0 ) ) {
+		/* EINTR */
+	}
+}
+
+void
+XvcReplay::run(FILE *f)
+{
+const XvcRecHdr *r;
+const uint8_t   *p;
+Stats            stats[NCMDS];
+int              pending  = -1;      // type of the last command
+unsigned long    pendLen  = 0;       // expected reply length
+uint64_t         pendTns  = 0;       // recorded timestamp of the last command
+uint64_t         recT0    = 0;
+uint64_t         repT0    = XvcRecorder::now();
+uint64_t         t;
+unsigned long    tgtVecLen;
+unsigned long    bits;
+unsigned long    bitsTot  = 0;
+unsigned long    mismatch = 0;
+unsigned long    skipped  = 0;
+unsigned long    failed   = 0;
+uint32_t         period;
+CmdType          cmd;
+unsigned         i;
+
+	// the recording may start in the middle of a session (ring wrapped)
+	if ( 0 == (tgtVecLen = drv_->query()) ) {
+		tgtVecLen = maxVecLen_;
+	}
+	supVecLen_ = drv_->getMaxVectorSize();
+	if ( 0 == supVecLen_ || tgtVecLen < supVecLen_ ) {
+		supVecLen_ = tgtVecLen;
+	}
+
+	while ( (r = rec_.next()) ) {
+		p = (const uint8_t*)(r + 1);
+
+		if ( XvcRecorder::XVC_REP == r->type ) {
+			if ( pending >= 0 ) {
+				stats[pending].recorded.push_back( r->tns - pendTns );
+				if (    SHIFT == pending
+				    && ! (r->flags & XvcRecorder::TRUNCATED)
+				    && ( r->len != pendLen || memcmp( p, &tdo_[0], pendLen ) ) ) {
+					mismatch++;
+				}
+			}
+			pending = -1;
+			continue;
+		}
+
+		if ( XvcRecorder::XVC_CMD != r->type ) {
+			continue;
+		}
+
+		pending = -1;
+
+		if ( (r->flags & XvcRecorder::TRUNCATED) || r->len < 2 ) {
+			skipped++;
+			continue;
+		}
+
+		if ( 0 == memcmp( p, "ge", 2 ) ) {
+			cmd = GETINFO;
+		} else if ( 0 == memcmp( p, "se", 2 ) && r->len >= 11 ) {
+			cmd = SETTCK;
+		} else if ( 0 == memcmp( p, "sh", 2 ) && r->len >= 10 ) {
+			cmd = SHIFT;
+			bits = p[6] | (p[7] << 8) | (p[8] << 16) | ((unsigned long)p[9] << 24);
+			if ( (bits + 7)/8 > maxVecLen_ || r->len < 10 + 2*((bits + 7)/8) ) {
+				skipped++;
+				continue;
+			}
+			// the driver wants writable buffers
+			vec_.resize( 2*((bits + 7)/8) );
+			tdo_.resize( (bits + 7)/8 );
+			memcpy( &vec_[0], p + 10, 2*((bits + 7)/8) );
+			pendLen = (bits + 7)/8;
+		} else {
+			skipped++;
+			continue;
+		}
+
+		if ( 0 == recT0 ) {
+			recT0 = r->tns;
+		}
+		if ( timed_ ) {
+			sleepUntil( repT0 + (r->tns - recT0) );
+		}
+
+		t = XvcRecorder::now();
+		try {
+			switch ( cmd ) {
+				case GETINFO:
+					drv_->query();
+					break;
+
+				case SETTCK:
+					period = p[7] | (p[8] << 8) | (p[9] << 16) | ((uint32_t)p[10] << 24);
+					drv_->setPeriodNs( period );
+					break;
+
+				default:
+					shift( bits );
+					bitsTot += bits;
+					break;
+			}
+		} catch ( TimeoutErr &e ) {
+			failed++;
+			continue;
+		}
+		stats[cmd].replayed.push_back( XvcRecorder::now() - t );
+
+		pending = cmd;
+		pendTns = r->tns;
+	}
+
+	t = XvcRecorder::now() - repT0;
+
+	fprintf(f, "Replayed in %.3f s (%lu bits shifted; %.1f kbit/s)\n", t/1.0E9, bitsTot, t ? bitsTot/(t/1.0E6) : 0.0);
+	fprintf(f, "Skipped %lu, failed %lu commands; %lu TDO mismatches\n", skipped, failed, mismatch);
+	fprintf(f, "Latency (us)      count  replayed:       min       p50       p99       max  recorded:       p50       p99       max\n");
+	for ( i = 0; i < NCMDS; i++ ) {
+		stats[i].print( f, cmdName[i] );
+	}
+}
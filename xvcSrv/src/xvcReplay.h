@@ -0,0 +1,50 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#ifndef XVC_REPLAY_H
+#define XVC_REPLAY_H
+
+#include <xvcDriver.h>
+#include <xvcRecorder.h>
+
+// Replay the XVC commands of a session recording against a driver
+// (bypassing TCP) and report the latency of every command type
+// along with the latency observed while recording.
+class XvcReplay {
+private:
+	JtagDriver       *drv_;
+	XvcRecording      rec_;
+	bool              timed_;
+	unsigned long     maxVecLen_;
+	unsigned long     supVecLen_;
+
+	vector<uint8_t>   vec_;
+	vector<uint8_t>   tdo_;
+
+	void              shift(unsigned long bits);
+
+public:
+	// if 'timed' then commands are issued with the original timing,
+	// otherwise as fast as possible.
+	XvcReplay(JtagDriver *drv, const char *path, bool timed, unsigned long maxVecLen = 32768);
+
+	// replay and print a report to 'f'
+	virtual void run(FILE *f);
+
+	virtual ~XvcReplay() {}
+};
+
+#endif
@@ -0,0 +1,116 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#include <xvcSniffer.h>
+#include <xvcMetrics.h>
+#include <string.h>
+#include <stdio.h>
+
+static XvcCounter nDropped("xvc_sniff_dropped_total", "Number of shifts the sniffer had no room for");
+
+XvcSniffer::XvcSniffer()
+: stop_( false ),
+  lost_( 0     )
+{
+unsigned i;
+
+	for ( i = 0; i < sizeof(slots_)/sizeof(slots_[0]); i++ ) {
+		free_.push( &slots_[i] );
+	}
+	if ( pthread_create( &tid_, 0, threadFunc, this ) ) {
+		throw SysErr("XvcSniffer: unable to launch sniffer thread");
+	}
+}
+
+XvcSniffer::~XvcSniffer()
+{
+	stop_.store( true );
+	wake_.notify();
+	pthread_join( tid_, 0 );
+	if ( lost_ ) {
+		fprintf(stderr, "WARNING: sniffer dropped the last %lu shift(s)\n", lost_);
+	}
+}
+
+void *
+XvcSniffer::threadFunc(void *arg)
+{
+	((XvcSniffer*)arg)->run();
+	return 0;
+}
+
+void
+XvcSniffer::post(unsigned long bits, uint8_t *tms, uint8_t *tdi, uint8_t *tdo)
+{
+unsigned long bytes = (bits + 7)/8;
+Slot         *s;
+
+	if ( 0 == bits ) {
+		return;
+	}
+	if ( ! free_.pop( &s ) ) {
+		lost_++;
+		nDropped.inc();
+		return;
+	}
+	// slots only grow; once the biggest shift has been seen this
+	// no longer allocates
+	if ( s->buf_.size() < 3*bytes ) {
+		s->buf_.resize( 3*bytes );
+	}
+	memcpy( &s->buf_[0      ], tms, bytes );
+	memcpy( &s->buf_[  bytes], tdi, bytes );
+	memcpy( &s->buf_[2*bytes], tdo, bytes );
+	s->bits_ = bits;
+	s->lost_ = lost_;
+	lost_    = 0;
+	full_.push( s );
+	wake_.notify();
+}
+
+void
+XvcSniffer::process(Slot *s)
+{
+unsigned long bytes = (s->bits_ + 7)/8;
+
+	if ( s->lost_ ) {
+		// the TAP state is only known again after the next Test-Logic-Reset
+		fprintf(stderr, "WARNING: sniffer dropped %lu shift(s); what follows may be decoded incorrectly\n", s->lost_);
+	}
+	ctx_.processBuf( s->bits_, &s->buf_[0], &s->buf_[bytes], &s->buf_[2*bytes] );
+}
+
+void
+XvcSniffer::run()
+{
+Slot *s;
+
+	while ( true ) {
+		while ( full_.pop( &s ) ) {
+			process( s );
+			free_.push( s );
+		}
+		wake_.sleep();
+		if ( full_.empty() ) {
+			if ( stop_.load() ) {
+				break;
+			}
+			wake_.wait();
+		}
+		wake_.awake();
+	}
+	fflush( stderr );
+}
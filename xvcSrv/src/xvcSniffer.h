@@ -0,0 +1,77 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#ifndef XVC_SNIFFER_H
+#define XVC_SNIFFER_H
+
+#include <xvcPipeline.h>
+#include <jtagDump.h>
+
+// Sniff the JTAG traffic off the shift path: completed shifts are copied
+// into a bounded ring of slots and decoded (and printed) by a background
+// thread. If the thread falls behind then shifts are dropped (and counted)
+// rather than delaying the reply to the XVC client.
+//
+// There is a single producer (whichever thread currently owns the driver)
+// and a single consumer (the background thread); slots are passed back
+// and forth through two lock-free queues.
+class XvcSniffer {
+public:
+	// number of slots
+	static const unsigned LD_SLOTS = 7;
+
+private:
+	struct Slot {
+		unsigned long        bits_;
+		// shifts dropped before this one
+		unsigned long        lost_;
+		// tms, tdi, tdo (in this order)
+		std::vector<uint8_t> buf_;
+	};
+
+	typedef XvcSpscQueue<Slot*, LD_SLOTS> Queue;
+
+	JtagDumpCtx       ctx_;
+	Slot              slots_[ 1 << LD_SLOTS ];
+	Queue             free_;
+	Queue             full_;
+	XvcWakeup         wake_;
+	std::atomic<bool> stop_;
+	// producer
+	unsigned long     lost_;
+	pthread_t         tid_;
+
+	XvcSniffer(const XvcSniffer &);
+	XvcSniffer & operator=(const XvcSniffer &);
+
+	static void      *threadFunc(void *arg);
+
+	virtual void      process(Slot *s);
+
+public:
+	XvcSniffer();
+
+	// consumer thread
+	virtual void      run();
+
+	// producer; copies the vectors. Never blocks.
+	virtual void      post(unsigned long bits, uint8_t *tms, uint8_t *tdi, uint8_t *tdo);
+
+	// decodes what has been posted and terminates the thread
+	virtual ~XvcSniffer();
+};
+
+#endif
@@ -23,8 +23,15 @@
 #include <arpa/inet.h>
 #include <dlfcn.h>
 #include <pthread.h>
+#include <sys/epoll.h>
+#include <signal.h>
 #include <math.h>
 #include <jtagDump.h>
+#include <xvcMetrics.h>
+#include <xvcRecorder.h>
+#include <xvcReplay.h>
+#include <xvcPipeline.h>
+#include <xvcSniffer.h>
 
 // To be defined by Makefile
 #ifndef XVC_SRV_VERSION
@@ -35,11 +42,24 @@
 #define DEFAULTDRVNAME "udp"
 #endif
 
+static XvcCounter   nRetries ("xvc_drv_retries_total",    "Number of retransmissions to the target");
+static XvcCounter   nTimeouts("xvc_drv_timeouts_total",   "Number of timeouts waiting for the target");
+static XvcCounter   nFailures("xvc_drv_failures_total",   "Number of transfers which failed after all retries");
+static XvcHistogram hReformat("xvc_drv_reformat_seconds", "Time spent converting XVC vectors into a target message", 1.0E-9, 7);
+static XvcHistogram hXfer    ("xvc_drv_xfer_seconds",     "Time spent waiting for the target",                      1.0E-9, 7);
+static XvcHistogram hWait    ("xvc_client_wait_seconds",  "Time a client waited for the driver",                    1.0E-9, 10);
+static XvcCounter   nHandoffs("xvc_client_handoffs_total","Number of times the driver was passed to a waiting client");
+static XvcCounter   nMacroHit("xvc_drv_macro_hits_total", "Number of shifts sent as a reference to a macro");
+static XvcCounter   nMacroDef("xvc_drv_macro_defs_total", "Number of macros defined in the target");
+static XvcCounter   nMacroRtx("xvc_drv_macro_resent_total", "Number of shifts resent because the target lost a macro");
+static XvcCounter   nQryCache("xvc_drv_query_cached_total","Number of queries answered from the cache");
+
 JtagDriver::JtagDriver(int argc, char *const argv[], unsigned debug)
 : debug_ ( debug ),
   drop_  ( 0     ),
   drEn_  ( false ),
-  snif_  ( new JtagDumpCtx )
+  mfEn_  ( false ),
+  snif_  ( 0     )
 {
 }
 
@@ -58,6 +78,7 @@ void
 JtagDriver::setTestMode(unsigned flags)
 {
 	drEn_ = !!(flags & 1);
+	mfEn_ = !!(flags & 2);
 }
 
 unsigned
@@ -72,6 +93,63 @@ JtagDriver::getSniff()
 	return debug_ & 0x100;
 }
 
+void
+JtagDriver::setQueryTtl(unsigned)
+{
+}
+
+void
+JtagDriver::resetQuery()
+{
+}
+
+void
+JtagDriver::submitVectors(unsigned long numBits, uint8_t *tms, uint8_t *tdi, uint8_t *tdo)
+{
+	sendVectors( numBits, tms, tdi, tdo );
+}
+
+void
+JtagDriver::flushVectors()
+{
+}
+
+void
+JtagDriver::completeVectors()
+{
+}
+
+unsigned
+JtagDriver::getMaxInFlight()
+{
+	return 1;
+}
+
+int
+JtagDriver::asyncVectors()
+{
+	return -1;
+}
+
+bool
+JtagDriver::pollVectors()
+{
+	// adapter for drivers which can only block
+	completeVectors();
+	return true;
+}
+
+int
+JtagDriver::getPollTimeout()
+{
+	return -1;
+}
+
+void
+JtagDriver::abortVectors()
+{
+}
+
 SysErr::SysErr(const char *prefix)
 : std::runtime_error( std::string(prefix) + std::string(": ") + std::string(::strerror(errno)) )
 {
@@ -82,6 +160,11 @@ ProtoErr::ProtoErr(const char *msg)
 {
 }
 
+NoMacroErr::NoMacroErr(const char *msg)
+: ProtoErr( msg )
+{
+}
+
 TimeoutErr::TimeoutErr(const char *detail)
 : std::runtime_error( std::string("Timeout error; too many retries failed") + std::string(detail) )
 {
@@ -96,8 +179,23 @@ JtagDriverAxisToJtag::JtagDriverAxisToJtag( int argc, char *const argv[], unsign
 : JtagDriver( argc, argv, debug ),
   wordSize_ ( sizeof(Header)    ),
   memDepth_ ( 1                 ),
+  vers_     ( PVER0             ),
+  noPver1_  ( false             ),
+  caps_     ( 0                 ),
+  queryAt_  ( 0                 ),
+  queryTtl_ ( 0                 ),
+  queryOk_  ( false             ),
+  macroStamp_( 0                ),
+  macroPairs_( 0                ),
   retry_    ( 5                 ),
-  periodNs_ ( UNKNOWN_PERIOD    )
+  periodNs_ ( UNKNOWN_PERIOD    ),
+  winHd_    ( 0                 ),
+  winCnt_   ( 0                 ),
+  winQd_    ( 0                 ),
+  rxStride_ ( 0                 ),
+  maxInFlight_( 1               ),
+  attempt_  ( 0                 ),
+  async_    ( false             )
 {
 	// start out with an initial header size; it might be increased
 	// once we contacted the server...
@@ -105,6 +203,8 @@ JtagDriverAxisToJtag::JtagDriverAxisToJtag( int argc, char *const argv[], unsign
 	txBuf_.reserve( bufSz_     );
 	hdBuf_.reserve( hdBufMax() );
 	hdBuf_.resize ( hdBufMax() ); // fill with zeros
+	macroSeen_.resize( 256 );
+	ilv_ = JtagInterleaver::get( wordSize_, &ilvName_ );
 }
 
 
@@ -129,6 +229,19 @@ JtagDriverAxisToJtag::getCmd(Header x)
 	return x & CMD_MASK;
 }
 
+bool
+JtagDriverAxisToJtag::isReply(Header req, Header rep)
+{
+	if ( getCmd( rep ) == CMD_E ) {
+		return true;
+	}
+	if ( getCmd( rep ) != getCmd( req ) ) {
+		return false;
+	}
+	// the XID field of a query reply is used for other purposes
+	return getCmd( req ) == CMD_Q || getXid( req ) == getXid( rep );
+}
+
 unsigned
 JtagDriverAxisToJtag::getErr(Header   x)
 {
@@ -141,6 +254,12 @@ JtagDriverAxisToJtag::getErr(Header   x)
 unsigned long
 JtagDriverAxisToJtag::getLen(Header x)
 {
+	if ( getCmd(x) == CMD_X ) {
+		if ( (x & X_OP_MASK) == X_OP_DEFINE || (x & X_OP_MASK) == X_OP_MACRO ) {
+			return (x & X_MLEN_MASK) + 1;
+		}
+		return (x & X_LEN_MASK) + 1;
+	}
 	if ( getCmd(x) != CMD_S ) {
 		throw ProtoErr("Cannot extract length from non-shift command header");
 	}
@@ -162,6 +281,7 @@ JtagDriverAxisToJtag::getMsg(unsigned e)
 		case ERR_BAD_COMMAND:  return "Unsupported Command";
 		case ERR_TRUNCATED:    return "Unsupported Command";
 		case ERR_NOT_PRESENT:  return "XVC Support not Instantiated in Firmware";
+		case ERR_NO_MACRO:     return "Undefined Macro";
         default:    break;
 	}
 	return NULL;
@@ -169,16 +289,23 @@ JtagDriverAxisToJtag::getMsg(unsigned e)
 
 
 JtagDriverAxisToJtag::Header
-JtagDriverAxisToJtag::mkQuery()
+JtagDriverAxisToJtag::mkQuery(Header vers)
+{
+	return vers | CMD_Q | XID_ANY;
+}
+
+JtagDriverAxisToJtag::Header
+JtagDriverAxisToJtag::mkShift(unsigned len, Header vers)
 {
-	return PVERS | CMD_Q | XID_ANY;
+	len = len - 1;
+	return vers | CMD_S | newXid() | (len<<LEN_SHIFT);
 }
 
 JtagDriverAxisToJtag::Header
-JtagDriverAxisToJtag::mkShift(unsigned len)
+JtagDriverAxisToJtag::mkXCmd(Header op, unsigned len)
 {
 	len = len - 1;
-	return PVERS | CMD_S | newXid() | (len<<LEN_SHIFT);
+	return PVER1 | CMD_X | newXid() | op | (len & X_LEN_MASK);
 }
 
 unsigned
@@ -237,7 +364,7 @@ JtagDriverAxisToJtag::mkQueryReply(Header   protoVers, unsigned wordSize, unsign
 Header   rval;
 uint32_t periodEncoded = encPerNs( periodNs );
 
-	if ( protoVers != PVER0 ) {
+	if ( protoVers != PVER0 && protoVers != PVER1 ) {
 		throw std::runtime_error("mkQueryReply: unsupported protocol version");
 	}
 	if ( wordSize > 16 ) {
@@ -300,42 +427,77 @@ JtagDriverAxisToJtag::init()
 	query();
 }
 
+void
+JtagDriverAxisToJtag::chkErr(Header hdr)
+{
+unsigned e;
+
+	if ( (e = getErr( hdr )) ) {
+		char        errb[256];
+		const char *msg = getMsg( e );
+		int         pos;
+		pos = snprintf(errb, sizeof(errb), "Got error response from server -- ");
+		if ( msg ) {
+			snprintf(errb + pos, sizeof(errb) - pos, "%s", msg);
+		} else {
+			snprintf(errb + pos, sizeof(errb) - pos, "error %d", e);
+		}
+
+		flushMacros();
+		// the firmware may have changed (e.g., reloaded)
+		queryOk_ = false;
+		if ( ERR_NO_MACRO == e ) {
+			throw NoMacroErr(errb);
+		}
+		throw ProtoErr(errb);
+	}
+}
+
 int
 JtagDriverAxisToJtag::xferRel( uint8_t *txb, unsigned txBytes, Header *phdr, uint8_t *rxb, unsigned sizeBytes )
 {
-Xid      xid = getXid( getHdr( txb ) );
-unsigned attempt;
-unsigned e;
-int      got;
+Xid          xid = getXid( getHdr( txb ) );
+unsigned     attempt;
+int          got;
+XvcRecorder *rec = XvcRecorder::get();
+struct iovec iov[2];
 
 	for (attempt = 0; attempt <= retry_; attempt++ ) {
 		Header   hdr;
+		if ( attempt > 0 ) {
+			nRetries.inc();
+		}
+		if ( rec ) {
+			rec->record( XvcRecorder::TGT_MSG, XvcRecorder::now(), txb, txBytes );
+		}
 		try {
-			got = xfer( txb, txBytes, &hdBuf_[0], getWordSize(), rxb, sizeBytes );
-			hdr = getHdr( &hdBuf_[0] );
-			if ( (e = getErr( hdr )) ) {
-				char        errb[256];
-                const char *msg = getMsg( e );
-                int         pos; 
-				pos = snprintf(errb, sizeof(errb), "Got error response from server -- ");
-				if ( msg ) {
-					snprintf(errb + pos, sizeof(errb) - pos, "%s", msg);
-				} else {
-					snprintf(errb + pos, sizeof(errb) - pos, "error %d", e);
-				}
-                
-				throw ProtoErr(errb);
+			{
+				XvcTimed tim( &hXfer );
+				got = xfer( txb, txBytes, &hdBuf_[0], getWordSize(), rxb, sizeBytes );
+			}
+			if ( rec ) {
+				iov[0].iov_base = &hdBuf_[0];
+				iov[0].iov_len  = getWordSize();
+				iov[1].iov_base = rxb;
+				iov[1].iov_len  = got;
+				rec->record( XvcRecorder::TGT_REP, XvcRecorder::now(), iov, 2 );
 			}
+			hdr = getHdr( &hdBuf_[0] );
+			chkErr( hdr );
 			if ( xid == XID_ANY || xid == getXid( hdr ) ) {
 				if ( phdr ) {
 					*phdr = hdr;
 				}
 				return got;
 			}
-		} catch (TimeoutErr) {
+		} catch (TimeoutErr &) {
+			nTimeouts.inc();
 		}
 	}
 
+	nFailures.inc();
+	flushMacros();
+	queryOk_ = false;
 	throw TimeoutErr();
 }
 
@@ -344,14 +506,55 @@ JtagDriverAxisToJtag::query()
 {
 Header   hdr;
 unsigned siz;
-
-	setHdr ( &txBuf_[0], mkQuery() );
+bool     got = false;
+uint8_t  capb[16];
+int      capl = 0;
 
 	if ( getDebug() > 1 ) {
 		fprintf(stderr, "query\n");
 	}
 
-	xferRel( &txBuf_[0], getWordSize(), &hdr, 0, 0 );
+	// a new connection; abandon whatever might still be in flight
+	abortVectors();
+
+	if ( queryOk_ && XvcRecorder::now() - queryAt_ < queryTtl_ ) {
+		// nothing has changed as far as we know
+		nQryCache.inc();
+		return getTgtVecSize();
+	}
+
+	if ( ! noPver1_ ) {
+		// try the most recent version first; older firmware rejects it
+		setHdr ( &txBuf_[0], mkQuery( PVER1 ) );
+		try {
+			capl = xferRel( &txBuf_[0], getWordSize(), &hdr, capb, sizeof(capb) );
+			got = true;
+		} catch ( ProtoErr &e ) {
+			if ( getDebug() > 0 ) {
+				fprintf(stderr, "PVER1 query rejected (%s); falling back to PVER0\n", e.what());
+			}
+			noPver1_ = true;
+		}
+	}
+	if ( ! got ) {
+		setHdr ( &txBuf_[0], mkQuery( PVER0 ) );
+		xferRel( &txBuf_[0], getWordSize(), &hdr, 0, 0 );
+	}
+
+	// firmware which ignores the version replies with its own
+	vers_     = getVrs( hdr ) == PVER1 ? PVER1 : PVER0;
+	caps_     = PVER1 == vers_ && capl >= (int)sizeof(uint32_t) ? getw32( capb ) : 0;
+
+	macroPairs_ = (caps_ >> CAP_PAIRS_SHIFT) & 0xff;
+	macros_.resize( macroPairs_ ? ((caps_ >> CAP_SLOTS_SHIFT) & 0xff) : 0 );
+	if ( macros_.size() > (X_SLOT_MASK >> X_SLOT_SHIFT) + 1 ) {
+		macros_.resize( (X_SLOT_MASK >> X_SLOT_SHIFT) + 1 );
+	}
+	if ( macros_.empty() ) {
+		// no slots; don't use macros at all
+		macroPairs_ = 0;
+	}
+	flushMacros();
 
 	wordSize_ = wordSize( hdr );
 	if ( wordSize_  < sizeof(hdr) ) {
@@ -359,9 +562,10 @@ unsigned siz;
 	}
 	memDepth_ = memDepth( hdr );
 	periodNs_ = cvtPerNs( hdr );
+	ilv_      = JtagInterleaver::get( wordSize_, &ilvName_ );
 
 	if ( getDebug() > 1 ) {
-		fprintf(stderr, "query result: wordSize %d, memDepth %d, period %ldns\n", wordSize_, memDepth_, (unsigned long)periodNs_);
+		fprintf(stderr, "query result: version %d, caps 0x%x, wordSize %d, memDepth %d, period %ldns\n", vers_ >> 30, caps_, wordSize_, memDepth_, (unsigned long)periodNs_);
 	}
 
 	if ( 0 == memDepth_ )
@@ -369,11 +573,50 @@ unsigned siz;
 	else
 		retry_ = 5;
 
-	if ( (siz = (2*memDepth_ + 1) * wordSize_) > bufSz_ ) {
+	if ( (siz = 2*getTgtVecSize() + wordSize_) > bufSz_ ) {
 		bufSz_ = siz;
 		txBuf_.reserve( bufSz_ );
 	}
 
+	queryAt_ = XvcRecorder::now();
+	queryOk_ = true;
+
+	return getTgtVecSize();
+}
+
+void
+JtagDriverAxisToJtag::setQueryTtl(unsigned ms)
+{
+	queryTtl_ = (uint64_t)ms * 1000000ULL;
+}
+
+void
+JtagDriverAxisToJtag::resetQuery()
+{
+	queryOk_ = false;
+	// the firmware may have been upgraded
+	noPver1_ = false;
+}
+
+JtagDriverAxisToJtag::Header
+JtagDriverAxisToJtag::getProtoVers()
+{
+	return vers_;
+}
+
+uint32_t
+JtagDriverAxisToJtag::getCaps()
+{
+	return caps_;
+}
+
+unsigned long
+JtagDriverAxisToJtag::getTgtVecSize()
+{
+	// caps_ is only set for PVER1
+	if ( memDepth_ > 0 && (caps_ & CAP_VLEN_MASK) ) {
+		return ((caps_ & CAP_VLEN_MASK) >> CAP_VLEN_SHIFT) * CAP_VLEN_UNIT * wordSize_;
+	}
 	return memDepth_ * wordSize_;
 }
 
@@ -420,8 +663,8 @@ const char *pre = tdi ? "TMS" : "TDO";
 	fprintf(stderr, "\", nbits => %d),\n", nbits);
 }
 
-void
-JtagDriverAxisToJtag::sendVectors(unsigned long bits, uint8_t *tms, uint8_t *tdi, uint8_t *tdo)
+unsigned
+JtagDriverAxisToJtag::mkShiftMsg(uint8_t *buf, unsigned long bits, uint8_t *tms, uint8_t *tdi)
 {
 unsigned      wsz = getWordSize();
 
@@ -433,27 +676,75 @@ unsigned      bytesLeft      = bytesCeil - wholeWordBytes;
 unsigned      bytesTot       = wsz + 2*wordCeilBytes;
 int           lastbits       = bits - 8ULL*wholeWordBytes;
 unsigned      idx;
-int           bidx;
+bool          lastTms;
+bool          hit;
+int           slot = -1;
 
 uint8_t       *wp;
 
+XvcTimed       tim( &hReformat );
+
 	if ( getDebug() > 1 ) {
 		fprintf(stderr, "sendVec -- bits %ld, bytes %ld, bytesTot %d\n", bits, bytesCeil, bytesTot);
 	}
 
-	setHdr( &txBuf_[0], mkShift( bits ) );
+	if ( macroPairs_ && bits <= X_MLEN_MASK + 1 && wordCeilBytes <= macroPairs_*wsz ) {
+		slot = findMacro( bits, tms, tdi, &hit );
+		if ( slot >= 0 && hit ) {
+			setHdr( buf, mkXCmd( X_OP_MACRO | (slot << X_SLOT_SHIFT), bits ) );
+			nMacroHit.inc();
+			if ( getDebug() > 1 ) {
+				fprintf(stderr, "sendVec -- macro %d\n", slot);
+			}
+			return wsz;
+		}
+	}
+
+	if ( slot >= 0 ) {
+		// define a macro; the payload is in the PVER0 layout
+		setHdr( buf, mkXCmd( X_OP_DEFINE | (slot << X_SLOT_SHIFT), bits ) );
+		nMacroDef.inc();
+		if ( getDebug() > 1 ) {
+			fprintf(stderr, "sendVec -- defining macro %d\n", slot);
+		}
+	} else if ( (caps_ & CAP_TDI_SHIFT) && bits <= X_LEN_MASK + 1 && tmsIdle( tms, bits, &lastTms ) ) {
+		// the TMS vector is implicit
+		setHdr( buf, mkXCmd( lastTms ? X_OP_TDI_EXIT : X_OP_TDI, bits ) );
+		memcpy( buf + wsz, tdi, bytesCeil );
+		memset( buf + wsz + bytesCeil, 0, wordCeilBytes - bytesCeil );
+		if ( getDebug() > 1 ) {
+			fprintf(stderr, "sendVec -- TDI only (TMS on last bit %d)\n", lastTms);
+		}
+		return wsz + wordCeilBytes;
+	}
+
+	if ( slot < 0 && PVER1 == vers_ ) {
+		unsigned long rleBits = bits;
+		unsigned      rleTot;
+		// only use the encoding if it is smaller
+		rleTot = mkRleMsg( buf, &rleBits, tms, tdi, bytesTot - 1 );
+		if ( rleBits == bits ) {
+			setHdr( buf, mkShift( bits, PVER1 ) );
+			if ( getDebug() > 1 ) {
+				fprintf(stderr, "sendVec -- run-length encoded into %d bytes\n", rleTot);
+			}
+			return rleTot;
+		}
+	}
+
+	if ( slot < 0 ) {
+		setHdr( buf, mkShift( bits, PVER0 ) );
+	}
 
 	// reformat
 
-	wp = &txBuf_[0] + wsz; // past header
+	wp = buf + wsz; // past header
 
 	// store sequence of TMS/TDI pairs; word-by-word
-	for ( idx=0; idx < wholeWordBytes; idx += wsz ) {
-		memcpy( wp, & tms[idx], wsz );
-		wp  += wsz;
-		memcpy( wp, & tdi[idx], wsz );
-		wp  += wsz;
-	}
+	ilv_( wp, tms, tdi, wholeWords, wsz );
+	wp  += 2*wholeWordBytes;
+	idx  = wholeWordBytes;
+
 	if ( bytesLeft ) {
 		memcpy( wp,       & tms[idx], bytesLeft );
 		memcpy( wp + wsz, & tdi[idx], bytesLeft );
@@ -468,134 +759,1299 @@ uint8_t       *wp;
 		}
 	}
 
-	xferRel( &txBuf_[0], bytesTot, 0, tdo, bytesCeil );
+	return bytesTot;
+}
 
-	if ( getDebug() > 1 ) {
-		for ( idx=0; idx < wholeWordBytes; idx += wsz ) {
-			prwrds(stderr, tdo + idx, 0, wsz, 8*wsz);
-		}
-		if ( bytesLeft ) {
-			prwrds(stderr, tdo + idx, 0, wsz, lastbits);
-		}
-	}
+unsigned
+JtagDriverAxisToJtag::rleClass(uint8_t *p, unsigned l)
+{
+uint8_t  v = p[0];
+unsigned i;
 
-	if ( getSniff() ) {
-		snif_->processBuf( bits, tms, tdi, tdo );
+	if ( 0x00 != v && 0xff != v ) {
+		return RLE_LIT;
+	}
+	for ( i = 1; i < l; i++ ) {
+		if ( p[i] != v ) {
+			return RLE_LIT;
+		}
 	}
+	return 0x00 == v ? RLE_ZEROS : RLE_ONES;
 }
 
 void
-JtagDriverAxisToJtag::dumpInfo(FILE *f)
+JtagDriverAxisToJtag::flushMacros()
 {
-	fprintf(f, "Word size:                  %d\n",  getWordSize());
-	fprintf(f, "Target Memory Depth (bytes) %d\n",  getWordSize() * getMemDepth());
-	fprintf(f, "Max. Vector Length  (bytes) %ld\n", getMaxVectorSize());
-	fprintf(f, "TCK Period             (ns) %ld\n", (unsigned long)getPeriodNs());
+unsigned i;
+
+	for ( i = 0; i < macros_.size(); i++ ) {
+		macros_[i].used_ = 0;
+	}
 }
 
-void
-JtagDriverAxisToJtag::usage()
+int
+JtagDriverAxisToJtag::findMacro(unsigned long bits, uint8_t *tms, uint8_t *tdi, bool *hit)
 {
+unsigned long bytes  = (bits + 8 - 1)/8;
+uint8_t       mask   = 0xff >> (8*bytes - bits);
+uint32_t      h      = 2166136261U ^ bits;
+unsigned      victim = 0;
+unsigned      i;
+Macro        *m;
+
+	macroKey_.resize( 2*bytes );
+	memcpy( &macroKey_[0],     tms, bytes );
+	memcpy( &macroKey_[bytes], tdi, bytes );
+	macroKey_[  bytes - 1] &= mask;
+	macroKey_[2*bytes - 1] &= mask;
+
+	macroStamp_++;
+
+	for ( i = 0; i < macros_.size(); i++ ) {
+		m = &macros_[i];
+		if ( m->used_ && m->bits_ == bits && m->pat_ == macroKey_ ) {
+			m->used_ = macroStamp_;
+			*hit     = true;
+			return i;
+		}
+		if ( m->used_ < macros_[victim].used_ ) {
+			victim = i;
+		}
+	}
+
+	*hit = false;
+
+	// FNV-1a
+	for ( i = 0; i < macroKey_.size(); i++ ) {
+		h = (h ^ macroKey_[i]) * 16777619U;
+	}
+	if ( macroSeen_[ h % macroSeen_.size() ] != h ) {
+		macroSeen_[ h % macroSeen_.size() ] = h;
+		return -1;
+	}
+
+	m         = &macros_[victim];
+	m->bits_  = bits;
+	m->pat_   = macroKey_;
+	m->used_  = macroStamp_;
+	return victim;
 }
 
-SockSd::SockSd(bool stream)
+bool
+JtagDriverAxisToJtag::tmsIdle(uint8_t *tms, unsigned long bits, bool *lastTms)
 {
-	if ( (sd_ = ::socket( AF_INET, stream ? SOCK_STREAM : SOCK_DGRAM, 0 )) < 0 ) {
-		throw SysErr("Unable to create Socket");
+unsigned long bytes = (bits + 8 - 1)/8;
+unsigned long i;
+uint8_t       last;
+
+	for ( i = 0; i < bytes - 1; i++ ) {
+		if ( tms[i] ) {
+			return false;
+		}
+	}
+	last = tms[bytes - 1];
+	if ( 0 != last && (1 << ((bits - 1) % 8)) != last ) {
+		return false;
 	}
+	*lastTms = !!last;
+	return true;
 }
 
-SockSd::~SockSd()
+unsigned
+JtagDriverAxisToJtag::mkRleMsg(uint8_t *buf, unsigned long *bits, uint8_t *tms, uint8_t *tdi, unsigned maxBytes)
 {
-	::close( sd_ );
+unsigned      wsz   = getWordSize();
+unsigned long bytes = (*bits + 8 - 1)/8;
+unsigned long nw    = (bytes + wsz - 1)/wsz;
+unsigned long w;
+unsigned long run   = 0;
+unsigned      len   = wsz; // header
+unsigned      ctl   = 0;   // offset of the current control word
+unsigned      cls   = 0;
+unsigned      c, l, need;
+bool          fresh;
+
+	for ( w = 0; w < nw; w++ ) {
+		l     = w == nw - 1 ? bytes - w*wsz : wsz;
+		c     = rleClass( tms + w*wsz, l ) | ( rleClass( tdi + w*wsz, l ) << RLE_TDI_SHIFT );
+		fresh = 0 == run || c != cls || RLE_MAX_RUN == run;
+		need  = fresh ? wsz : 0;
+		if ( RLE_LIT == (c & RLE_MODE_MASK) ) {
+			need += wsz;
+		}
+		if ( RLE_LIT == (c >> RLE_TDI_SHIFT) ) {
+			need += wsz;
+		}
+		if ( len + need > maxBytes ) {
+			break;
+		}
+		if ( fresh ) {
+			// close the current record and open a new one
+			if ( buf && run ) {
+				setw32( buf + ctl, cls | ((run - 1) << RLE_CNT_SHIFT) );
+				memset( buf + ctl + 4, 0, wsz - 4 );
+			}
+			ctl  = len;
+			len += wsz;
+			cls  = c;
+			run  = 0;
+		}
+		if ( RLE_LIT == (c & RLE_MODE_MASK) ) {
+			if ( buf ) {
+				memcpy( buf + len, tms + w*wsz, l );
+				memset( buf + len + l, 0, wsz - l );
+			}
+			len += wsz;
+		}
+		if ( RLE_LIT == (c >> RLE_TDI_SHIFT) ) {
+			if ( buf ) {
+				memcpy( buf + len, tdi + w*wsz, l );
+				memset( buf + len + l, 0, wsz - l );
+			}
+			len += wsz;
+		}
+		run++;
+	}
+	if ( buf && run ) {
+		setw32( buf + ctl, cls | ((run - 1) << RLE_CNT_SHIFT) );
+		memset( buf + ctl + 4, 0, wsz - 4 );
+	}
+	if ( w < nw ) {
+		*bits = 8*wsz*w;
+	}
+	return len;
 }
 
-int
-SockSd::getSd()
+unsigned long
+JtagDriverAxisToJtag::fitVectors(unsigned long bits, uint8_t *tms, uint8_t *tdi, unsigned maxBytes)
 {
-	return sd_;
+unsigned      wsz = getWordSize();
+unsigned long fit;
+unsigned long b;
+bool          lastTms;
+
+	// 2 vectors (padded to whole words) plus header
+	fit = 8*wsz*((maxBytes - wsz) / (2*wsz));
+	if ( fit >= bits ) {
+		return bits;
+	}
+	if ( caps_ & CAP_TDI_SHIFT ) {
+		// 1 vector plus header
+		b = 8*wsz*((maxBytes - wsz) / wsz);
+		if ( b > X_LEN_MASK + 1 ) {
+			b = X_LEN_MASK + 1;
+		}
+		if ( b > bits ) {
+			b = bits;
+		}
+		if ( b > fit && tmsIdle( tms, b, &lastTms ) ) {
+			if ( b == bits ) {
+				return bits;
+			}
+			fit = b;
+		}
+	}
+	if ( PVER1 == vers_ ) {
+		b = bits;
+		mkRleMsg( 0, &b, tms, tdi, maxBytes );
+		if ( b > fit ) {
+			fit = b;
+		}
+	}
+	return fit;
 }
 
-XvcServer::XvcServer(
-	uint16_t    port,
-	JtagDriver *drv,
-	unsigned    debug,
-	unsigned    maxMsgSize,
-	bool        once
-)
-: sock_      ( true       ),
-  drv_       ( drv        ),
-  debug_     ( debug      ),
-  maxMsgSize_( maxMsgSize ),
-  once_      ( once       )
+void
+JtagDriverAxisToJtag::postShift(unsigned long bits, uint8_t *tms, uint8_t *tdi, uint8_t *tdo)
 {
-struct sockaddr_in a;
-int               yes = 1;
+unsigned      wsz = getWordSize();
 
-	a.sin_family      = AF_INET;
-	a.sin_addr.s_addr = INADDR_ANY;
-	a.sin_port        = htons( port );
+unsigned long bytesCeil      = (bits  +   8 - 1 )/8;
+unsigned      wholeWordBytes = (bytesCeil / wsz) * wsz;
+int           lastbits       = bits - 8ULL*wholeWordBytes;
+unsigned      idx;
 
-	if ( ::setsockopt( sock_.getSd(), SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes) ) ) {
-		throw SysErr("setsockopt(SO_REUSEADDR) failed");
+	if ( getDebug() > 1 ) {
+		for ( idx=0; idx < wholeWordBytes; idx += wsz ) {
+			prwrds(stderr, tdo + idx, 0, wsz, 8*wsz);
+		}
+		if ( bytesCeil > wholeWordBytes ) {
+			prwrds(stderr, tdo + idx, 0, wsz, lastbits);
+		}
 	}
 
-
-	if ( ::bind( sock_.getSd(), (struct sockaddr*)&a, sizeof(a) ) ) {
-		throw SysErr("Unable to bind Stream socket to local address");
+	if ( getSniff() ) {
+		if ( ! snif_ ) {
+			snif_ = new XvcSniffer();
+		}
+		snif_->post( bits, tms, tdi, tdo );
 	}
+}
 
-	if ( ::listen( sock_.getSd(), 1 ) ) {
-		throw SysErr("Unable to listen on socket");
+void
+JtagDriverAxisToJtag::sendVectors(unsigned long bits, uint8_t *tms, uint8_t *tdi, uint8_t *tdo)
+{
+unsigned long bytesCeil = (bits  +   8 - 1 )/8;
+unsigned      bytesTot;
+
+	bytesTot = mkShiftMsg( &txBuf_[0], bits, tms, tdi );
+
+	try {
+		xferRel( &txBuf_[0], bytesTot, 0, tdo, bytesCeil );
+	} catch ( NoMacroErr & ) {
+		// nothing was shifted; the cache is flushed now, so the vectors
+		// go out again as a definition or raw
+		nMacroRtx.inc();
+		bytesTot = mkShiftMsg( &txBuf_[0], bits, tms, tdi );
+		xferRel( &txBuf_[0], bytesTot, 0, tdo, bytesCeil );
 	}
 
+	postShift( bits, tms, tdi, tdo );
 }
 
 void
-XvcServer::run()
+JtagDriverAxisToJtag::xmit( uint8_t *, unsigned )
 {
-	do {
-	XvcConn conn( sock_.getSd(), drv_, maxMsgSize_ );
-		try {
-			conn.run();
-		} catch (SysErr &e) {
-			fprintf(stderr,"Closing connection (%s)\n", e.what());
-		}
-	} while ( ! once_ );
+	throw std::runtime_error("JtagDriverAxisToJtag: driver does not support pipelining (xmit)");
 }
 
-static void
-usage(const char *nm)
+int
+JtagDriverAxisToJtag::recv( uint8_t *, unsigned, uint8_t *, unsigned )
 {
-DriverRegistry *registry = DriverRegistry::get();
-
-	fprintf(stderr,"Usage: %s [-v{v}] [-Vh] [-D <driver>] [-p <port>] -t <target> [ -- <driver_options>]\n", nm);
-	fprintf(stderr,"  -t <target> : contact target (depends on driver; e.g., <ip[:port]>)\n");
-	fprintf(stderr,"  -h          : this message\n");
-	fprintf(stderr,"  -D <driver> : use transport driver 'driver'\n");
-	fprintf(stderr,"                   built-in drivers:\n");
-	registry->printRegisteredDrivers(stderr, "                   '%s'\n");
-	fprintf(stderr,"                   'udpLoopback'\n");
-	fprintf(stderr,"                the default driver is: '%s'\n", DEFAULTDRVNAME);
-	fprintf(stderr,"  -p <port>   : bind to TCP port <port> (default: 2542)\n");
-	fprintf(stderr,"  -M          : max XVC vector size (default 32768)\n");
-	fprintf(stderr,"  -v          : verbose (more 'v's increase verbosity)\n");
-	fprintf(stderr,"  -V          : print version information\n");
-	fprintf(stderr,"  -T <mode>   : set test mode/flags\n");
+	throw std::runtime_error("JtagDriverAxisToJtag: driver does not support pipelining (recv)");
 }
 
-static void *
+void
+JtagDriverAxisToJtag::xmitv( uint8_t * const *txbs, const unsigned *txBytes, unsigned n )
+{
+unsigned i;
+
+	for ( i = 0; i < n; i++ ) {
+		xmit( txbs[i], txBytes[i] );
+	}
+}
+
+unsigned
+JtagDriverAxisToJtag::recvv( uint8_t * const *hdbufs, unsigned hsize, uint8_t * const *rxbs, const unsigned *sizes, int *gots, unsigned )
+{
+	gots[0] = recv( hdbufs[0], hsize, rxbs[0], sizes[0] );
+	return 1;
+}
+
+int
+JtagDriverAxisToJtag::getRxFd()
+{
+	return -1;
+}
+
+unsigned
+JtagDriverAxisToJtag::tryRecvv( uint8_t * const *, unsigned, uint8_t * const *, const unsigned *, int *, unsigned )
+{
+	throw std::runtime_error("JtagDriverAxisToJtag: driver does not support event-driven completion (tryRecvv)");
+}
+
+int
+JtagDriverAxisToJtag::getRxTimeout()
+{
+	return -1;
+}
+
+void
+JtagDriverAxisToJtag::setMaxInFlight(unsigned n)
+{
+	if ( winCnt_ > 0 ) {
+		throw std::runtime_error("JtagDriverAxisToJtag: cannot change pipeline depth while busy");
+	}
+	// XIDs of messages in flight must be unique
+	if ( n > 128 ) {
+		n = 128;
+	}
+	if ( n < 1 ) {
+		n = 1;
+	}
+	maxInFlight_ = n;
+	win_.resize( n );
+	winHd_       = 0;
+	winQd_       = 0;
+
+	txv_.resize( n );
+	txl_.resize( n );
+	hdv_.resize( n );
+	rxv_.resize( n );
+	rxs_.resize( n );
+	rxg_.resize( n );
+	hdBufs_.resize( n * hdBufMax() );
+	rxBuf_.resize( n * rxStride_ );
+}
+
+bool
+JtagDriverAxisToJtag::syncVectors()
+{
+	return getMaxInFlight() <= 1 && ! async_;
+}
+
+unsigned
+JtagDriverAxisToJtag::getMaxInFlight()
+{
+	// The firmware can only play back the reply to the most recent
+	// transaction. If a message was lost while others are in flight
+	// then these would be executed out of order (and retrying the lost
+	// one would execute it a second time). Therefore, we can only
+	// pipeline if the target has no memory, i.e., when the transport
+	// must be reliable anyways.
+	if ( getMemDepth() > 0 ) {
+		return 1;
+	}
+	return maxInFlight_;
+}
+
+void
+JtagDriverAxisToJtag::submitVectors(unsigned long bits, uint8_t *tms, uint8_t *tdi, uint8_t *tdo)
+{
+unsigned long bytesCeil = (bits  +   8 - 1 )/8;
+unsigned      wsz       = getWordSize();
+Xact         *x;
+
+	if ( syncVectors() ) {
+		sendVectors( bits, tms, tdi, tdo );
+		return;
+	}
+
+	if ( winCnt_ >= getMaxInFlight() ) {
+		throw std::runtime_error("JtagDriverAxisToJtag: too many transactions in flight");
+	}
+
+	x = &win_[ (winHd_ + winCnt_) % win_.size() ];
+
+	if ( x->msg_.size() < wsz + 2*(bytesCeil + wsz) ) {
+		x->msg_.resize( wsz + 2*(bytesCeil + wsz) );
+	}
+	if ( rxStride_ < bytesCeil ) {
+		rxStride_ = bytesCeil;
+		rxBuf_.resize( win_.size() * rxStride_ );
+	}
+
+	x->len_      = mkShiftMsg( &x->msg_[0], bits, tms, tdi );
+	x->xid_      = getXid( getHdr( &x->msg_[0] ) );
+	x->bits_     = bits;
+	x->tms_      = tms;
+	x->tdi_      = tdi;
+	x->tdo_      = tdo;
+	x->tdoBytes_ = bytesCeil;
+	x->done_     = false;
+
+	winCnt_++;
+	// hold back until 'flushVectors()' so that messages may be batched
+	winQd_++;
+}
+
+void
+JtagDriverAxisToJtag::xmitWin(unsigned from)
+{
+unsigned n = 0;
+unsigned i;
+Xact    *x;
+
+	for ( i = from; i < winCnt_; i++ ) {
+		x = &win_[ (winHd_ + i) % win_.size() ];
+		txv_[n] = &x->msg_[0];
+		txl_[n] = x->len_;
+		n++;
+	}
+	if ( n > 0 ) {
+		if ( XvcRecorder *rec = XvcRecorder::get() ) {
+			uint64_t now = XvcRecorder::now();
+			for ( i = 0; i < n; i++ ) {
+				rec->record( XvcRecorder::TGT_MSG, now, txv_[i], txl_[i] );
+			}
+		}
+		xmitv( &txv_[0], &txl_[0], n );
+	}
+}
+
+void
+JtagDriverAxisToJtag::flushVectors()
+{
+unsigned from = winCnt_ - winQd_;
+
+	if ( winQd_ > 0 ) {
+		winQd_ = 0;
+		xmitWin( from );
+	}
+}
+
+bool
+JtagDriverAxisToJtag::redoMacro(Header hdr)
+{
+unsigned sent = winCnt_ - winQd_;
+Header   h;
+Xact    *x;
+
+	if ( ERR_NO_MACRO != getErr( hdr ) || 0 == sent ) {
+		return false;
+	}
+	// the firmware executes in order; had anything been sent after the
+	// failed shift then it would have been executed first
+	x = &win_[ (winHd_ + sent - 1) % win_.size() ];
+	h = getHdr( &x->msg_[0] );
+	if ( x->done_ || x->xid_ != getXid( hdr ) || CMD_X != getCmd( h ) || X_OP_MACRO != (h & X_OP_MASK) ) {
+		return false;
+	}
+	// once the cache is flushed this goes out as a definition or raw
+	flushMacros();
+	nMacroRtx.inc();
+	x->len_ = mkShiftMsg( &x->msg_[0], x->bits_, x->tms_, x->tdi_ );
+	x->xid_ = getXid( getHdr( &x->msg_[0] ) );
+	winQd_  = 0;
+	xmitWin( sent - 1 );
+	return true;
+}
+
+unsigned
+JtagDriverAxisToJtag::recvReply(bool wait)
+{
+Header   hdr;
+unsigned i, k, n;
+unsigned got;
+int      len;
+Xact    *x;
+Xact    *dst  = 0;
+bool     fits = true;
+
+	// Replies normally arrive in order; receive the first one straight into
+	// the TDO buffer of the oldest unanswered transaction (which is scratch
+	// space until its own reply arrives). This is only possible if no other
+	// transaction in flight expects a longer reply. Any further replies
+	// (batched receive) go into bounce buffers.
+	for ( i = n = 0; i < winCnt_; i++ ) {
+		x = &win_[ (winHd_ + i) % win_.size() ];
+		if ( ! x->done_ ) {
+			if ( ! dst ) {
+				dst = x;
+			} else if ( x->tdoBytes_ > dst->tdoBytes_ ) {
+				fits = false;
+			}
+			hdv_[n] = &hdBufs_[ n * hdBufMax() ];
+			rxv_[n] = &rxBuf_ [ n * rxStride_  ];
+			rxs_[n] = rxStride_;
+			n++;
+		}
+	}
+
+	if ( dst && fits ) {
+		rxv_[0] = dst->tdo_;
+		rxs_[0] = dst->tdoBytes_;
+	}
+
+	if ( wait ) {
+		got = recvv( &hdv_[0], getWordSize(), &rxv_[0], &rxs_[0], &rxg_[0], n );
+	} else {
+		got = tryRecvv( &hdv_[0], getWordSize(), &rxv_[0], &rxs_[0], &rxg_[0], n );
+	}
+
+	for ( k = 0; k < got; k++ ) {
+		hdr = getHdr( hdv_[k] );
+		if ( redoMacro( hdr ) ) {
+			continue;
+		}
+		chkErr( hdr );
+
+		if ( (len = rxg_[k]) < 0 ) {
+			// truncated; treat as lost
+			if ( getDebug() > 1 ) {
+				fprintf(stderr, "dropping truncated reply (XID %d)\n", getXid( hdr ));
+			}
+			continue;
+		}
+
+		for ( i = 0; i < winCnt_; i++ ) {
+			x = &win_[ (winHd_ + i) % win_.size() ];
+			if ( ! x->done_ && x->xid_ == getXid( hdr ) ) {
+				break;
+			}
+		}
+
+		if ( i == winCnt_ ) {
+			// stale reply (e.g., to a retransmitted message); drop
+			if ( getDebug() > 1 ) {
+				fprintf(stderr, "dropping reply with stale XID %d\n", getXid( hdr ));
+			}
+			continue;
+		}
+
+		if ( (unsigned)len > x->tdoBytes_ ) {
+			len = x->tdoBytes_;
+		}
+		if ( rxv_[k] != x->tdo_ ) {
+			memcpy( x->tdo_, rxv_[k], len );
+		}
+		if ( XvcRecorder *rec = XvcRecorder::get() ) {
+			struct iovec iov[2];
+			iov[0].iov_base = hdv_[k];
+			iov[0].iov_len  = getWordSize();
+			iov[1].iov_base = x->tdo_;
+			iov[1].iov_len  = len;
+			rec->record( XvcRecorder::TGT_REP, XvcRecorder::now(), iov, 2 );
+		}
+		x->done_ = true;
+	}
+
+	return got;
+}
+
+void
+JtagDriverAxisToJtag::retry()
+{
+	nTimeouts.inc();
+	// Retries require a target with memory and then there is never more
+	// than a single transaction in flight (see 'getMaxInFlight()'); the
+	// firmware could not play back the replies of others anyways.
+	if ( ++attempt_ > retry_ || winCnt_ > 1 ) {
+		nFailures.inc();
+		attempt_ = 0;
+		flushMacros();
+		queryOk_ = false;
+		throw TimeoutErr();
+	}
+	nRetries.inc();
+	xmitWin( 0 );
+}
+
+void
+JtagDriverAxisToJtag::retire()
+{
+Xact *x = &win_[ winHd_ ];
+
+	postShift( x->bits_, x->tms_, x->tdi_, x->tdo_ );
+
+	winHd_   = (winHd_ + 1) % win_.size();
+	winCnt_--;
+	attempt_ = 0;
+}
+
+void
+JtagDriverAxisToJtag::completeVectors()
+{
+Xact    *x;
+
+	if ( 0 == winCnt_ ) {
+		// nothing in flight (synchronous mode)
+		return;
+	}
+
+	flushVectors();
+
+	x = &win_[ winHd_ ];
+
+	while ( ! x->done_ ) {
+		try {
+			XvcTimed tim( &hXfer );
+			recvReply( true );
+		} catch (TimeoutErr &) {
+			retry();
+		}
+	}
+
+	retire();
+}
+
+int
+JtagDriverAxisToJtag::asyncVectors()
+{
+int fd = getRxFd();
+
+	if ( winCnt_ > 0 ) {
+		throw std::runtime_error("JtagDriverAxisToJtag: cannot change completion mode while busy");
+	}
+	// a single message in flight also goes through the window now
+	async_ = ( fd >= 0 );
+	if ( async_ && win_.empty() ) {
+		setMaxInFlight( maxInFlight_ );
+	}
+	return fd;
+}
+
+bool
+JtagDriverAxisToJtag::pollVectors()
+{
+Xact    *x;
+
+	if ( ! async_ || 0 == winCnt_ ) {
+		// blocking driver or synchronous mode
+		completeVectors();
+		return true;
+	}
+
+	flushVectors();
+
+	x = &win_[ winHd_ ];
+
+	while ( ! x->done_ ) {
+		try {
+			if ( 0 == recvReply( false ) ) {
+				return false;
+			}
+		} catch (TimeoutErr &) {
+			retry();
+			return false;
+		}
+	}
+
+	retire();
+	return true;
+}
+
+void
+JtagDriverAxisToJtag::abortVectors()
+{
+	// late replies are dropped (stale XID)
+	winCnt_  = 0;
+	winQd_   = 0;
+	attempt_ = 0;
+	// and we don't know which macro definitions made it
+	flushMacros();
+}
+
+int
+JtagDriverAxisToJtag::getPollTimeout()
+{
+	if ( ! async_ || 0 == winCnt_ ) {
+		return -1;
+	}
+	return getRxTimeout();
+}
+
+void
+JtagDriverAxisToJtag::dumpInfo(FILE *f)
+{
+	fprintf(f, "Protocol version            %d\n",  getProtoVers() >> 30);
+	fprintf(f, "Capabilities                0x%x\n", getCaps());
+	fprintf(f, "Word size:                  %d\n",  getWordSize());
+	fprintf(f, "Target Memory Depth (bytes) %d\n",  getWordSize() * getMemDepth());
+	fprintf(f, "Max. Vector Length  (bytes) %ld\n", getMaxVectorSize());
+	fprintf(f, "TCK Period             (ns) %ld\n", (unsigned long)getPeriodNs());
+	fprintf(f, "Vector interleave kernel    %s\n",  ilvName_);
+}
+
+void
+JtagDriverAxisToJtag::usage()
+{
+}
+
+SockSd::SockSd(bool stream)
+{
+	if ( (sd_ = ::socket( AF_INET, stream ? SOCK_STREAM : SOCK_DGRAM, 0 )) < 0 ) {
+		throw SysErr("Unable to create Socket");
+	}
+}
+
+SockSd::~SockSd()
+{
+	::close( sd_ );
+}
+
+int
+SockSd::getSd()
+{
+	return sd_;
+}
+
+// SIGHUP makes the servers forget the target parameters cached by the
+// driver (e.g., after loading a new bitstream)
+static volatile sig_atomic_t hupCount = 0;
+
+static void
+onHup(int)
+{
+	hupCount = hupCount + 1;
+}
+
+XvcServer::XvcServer(
+	uint16_t    port,
+	JtagDriver *drv,
+	unsigned    debug,
+	unsigned    maxMsgSize,
+	bool        once,
+	unsigned    sliceMs,
+	bool        pipelined,
+	int         drvCpu,
+	bool        async,
+	bool        profile
+)
+: sock_      ( true       ),
+  drv_       ( drv        ),
+  debug_     ( debug      ),
+  maxMsgSize_( maxMsgSize ),
+  once_      ( once       ),
+  tap_       ( true       ),
+  slice_     ( sliceMs * 1000000ULL ),
+  grantedAt_ ( 0          ),
+  pipelined_ ( pipelined  ),
+  drvCpu_    ( drvCpu     ),
+  pipe_      ( 0          ),
+  async_     ( async && ! pipelined ),
+  drvFd_     ( -1         ),
+  drvArmed_  ( false      ),
+  profile_   ( profile    ),
+  hups_      ( hupCount   )
+{
+struct sockaddr_in a;
+struct epoll_event ev;
+int               yes = 1;
+
+	a.sin_family      = AF_INET;
+	a.sin_addr.s_addr = INADDR_ANY;
+	a.sin_port        = htons( port );
+
+	if ( ::setsockopt( sock_.getSd(), SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes) ) ) {
+		throw SysErr("setsockopt(SO_REUSEADDR) failed");
+	}
+
+
+	if ( ::bind( sock_.getSd(), (struct sockaddr*)&a, sizeof(a) ) ) {
+		throw SysErr("Unable to bind Stream socket to local address");
+	}
+
+	if ( ::listen( sock_.getSd(), 8 ) ) {
+		throw SysErr("Unable to listen on socket");
+	}
+
+	if ( (epfd_ = epoll_create1( EPOLL_CLOEXEC )) < 0 ) {
+		throw SysErr("Unable to create epoll instance");
+	}
+
+	ev.events   = EPOLLIN;
+	ev.data.ptr = 0; // the listening socket
+	if ( epoll_ctl( epfd_, EPOLL_CTL_ADD, sock_.getSd(), &ev ) ) {
+		::close( epfd_ );
+		throw SysErr("Unable to add listening socket to epoll set");
+	}
+}
+
+XvcServer::~XvcServer()
+{
+	::close( epfd_ );
+}
+
+void
+XvcServer::accept()
+{
+Client            *c = new Client();
+struct epoll_event ev;
+
+	if ( hups_ != hupCount ) {
+		// the firmware may have been reloaded; ask it again
+		hups_ = hupCount;
+		drv_->resetQuery();
+	}
+
+	c->waiting_   = false;
+	c->waitSince_ = 0;
+	c->grants_    = 0;
+	c->waitTot_   = 0;
+	c->waitMax_   = 0;
+	try {
+		c->conn_ = new XvcConn( sock_.getSd(), drv_, maxMsgSize_, &tap_, pipe_, async_, profile_ );
+	} catch (std::runtime_error &e) {
+		delete c;
+		fprintf(stderr,"Unable to accept connection (%s)\n", e.what());
+		return;
+	}
+
+	ev.events   = EPOLLIN;
+	ev.data.ptr = c;
+	if ( epoll_ctl( epfd_, EPOLL_CTL_ADD, c->conn_->getSd(), &ev ) ) {
+		close( c, "unable to add to epoll set" );
+	}
+}
+
+void
+XvcServer::update(Client *c)
+{
+struct epoll_event ev;
+
+	ev.events   = 0;
+	// clients waiting for the driver are not read (level-triggered!)
+	if ( ! c->waiting_ && c->conn_->wantRead() ) {
+		ev.events |= EPOLLIN;
+	}
+	if ( c->conn_->wantWrite() ) {
+		ev.events |= EPOLLOUT;
+	}
+	ev.data.ptr = c;
+	if ( epoll_ctl( epfd_, EPOLL_CTL_MOD, c->conn_->getSd(), &ev ) ) {
+		throw SysErr("Unable to modify epoll set");
+	}
+}
+
+void
+XvcServer::close(Client *c, const char *why)
+{
+std::deque<Client*>::iterator it;
+
+	fprintf(stderr,"Closing connection (%s)\n", why);
+	if ( c->grants_ > 1 || c->waitTot_ > 0 ) {
+		fprintf(stderr,"  driver granted %lu times; waited %.3f s total, %.3f s max.\n",
+			c->grants_, c->waitTot_/1.0E9, c->waitMax_/1.0E9);
+	}
+	if ( c->conn_->getProfile() ) {
+		c->conn_->getProfile()->print( stderr );
+	}
+
+	for ( it = waitq_.begin(); it != waitq_.end(); ++it ) {
+		if ( *it == c ) {
+			waitq_.erase( it );
+			break;
+		}
+	}
+
+	epoll_ctl( epfd_, EPOLL_CTL_DEL, c->conn_->getSd(), 0 );
+
+	if ( pipe_ && owner_ == c ) {
+		// the driver thread may still be working on our buffers
+		pipe_->drain();
+	} else if ( owner_ == c && c->conn_->pending() ) {
+		// the driver must not write to our buffers anymore
+		drv_->abortVectors();
+	}
+
+	delete c->conn_;
+	c->conn_ = 0;
+
+	if ( owner_ == c ) {
+		// the TAP may be left in any state; nothing we can do about it.
+		// The next client usually resets the TAP anyways.
+		owner_ = 0;
+		// a queued client still gets its turn
+		if ( once_ && waitq_.empty() ) {
+			done_ = true;
+		}
+	}
+	// there may be more events for 'c' in the current batch
+	dead_.push_back( c );
+
+	if ( debug_ > 0 ) {
+		// statistics gathered during the session
+		drv_->dumpInfo();
+	}
+}
+
+void
+XvcServer::assign(Client *c)
+{
+uint64_t now = XvcRecorder::now();
+uint64_t w;
+
+	if ( c->waiting_ ) {
+		w = now - c->waitSince_;
+		hWait.observe( w );
+		c->waitTot_ += w;
+		if ( w > c->waitMax_ ) {
+			c->waitMax_ = w;
+		}
+		c->waiting_ = false;
+	}
+	c->grants_++;
+	owner_     = c;
+	grantedAt_ = now;
+}
+
+bool
+XvcServer::grant(Client *c)
+{
+	if ( owner_ && owner_ != c ) {
+		if ( ! c->waiting_ ) {
+			c->waiting_   = true;
+			c->waitSince_ = XvcRecorder::now();
+			waitq_.push_back( c );
+		}
+		return false;
+	}
+	if ( ! owner_ ) {
+		assign( c );
+	}
+	return true;
+}
+
+bool
+XvcServer::process(Client *c)
+{
+	try {
+		c->conn_->process();
+	} catch (std::runtime_error &e) {
+		// this also catches driver errors (e.g., timeouts); the other
+		// clients are unaffected
+		close( c, e.what() );
+		return false;
+	}
+	return true;
+}
+
+void
+XvcServer::release(Client *c)
+{
+Client *w;
+
+	if ( c ) {
+		if (    owner_ != c
+		     || waitq_.empty()
+		     || c->conn_->busy()
+		     || ! tap_.isIdle()
+		     || XvcRecorder::now() - grantedAt_ < slice_ ) {
+			// keep it
+			return;
+		}
+		owner_ = 0;
+	} else if ( owner_ ) {
+		return;
+	}
+
+	while ( ! owner_ && ! waitq_.empty() ) {
+		w = waitq_.front();
+		waitq_.pop_front();
+		nHandoffs.inc();
+		assign( w );
+		// process what 'w' has buffered while waiting
+		if ( process( w ) ) {
+			update( w );
+		}
+	}
+}
+
+int
+XvcServer::timeout()
+{
+uint64_t el;
+int      tmo = -1;
+int      drv;
+
+	if ( owner_ && ! waitq_.empty() ) {
+		el = XvcRecorder::now() - grantedAt_;
+		// once expired the owner is not at a safe point and
+		// its next command will trigger the handoff.
+		if ( el < slice_ ) {
+			tmo = (slice_ - el + 999999)/1000000;
+		}
+	}
+	if ( drvArmed_ && (drv = drv_->getPollTimeout()) >= 0 && ( tmo < 0 || drv < tmo ) ) {
+		tmo = drv;
+	}
+	return tmo;
+}
+
+void
+XvcServer::complete()
+{
+Client  *c;
+XvcJob   j;
+unsigned n = 0;
+
+	while ( pipe_->pop( &j ) ) {
+		n++;
+		// only the owner has chunks in flight
+		if ( ! (c = owner_) ) {
+			continue;
+		}
+		if ( j.failed_ ) {
+			close( c, pipe_->getError() );
+			continue;
+		}
+		try {
+			c->conn_->chunkDone();
+		} catch ( SysErr &e ) {
+			close( c, e.what() );
+		}
+	}
+
+	if ( 0 == n ) {
+		return;
+	}
+
+	if ( ! (c = owner_) ) {
+		release( 0 );
+	} else if ( process( c ) ) {
+		update( c );
+		release( c );
+	} else {
+		release( 0 );
+	}
+}
+
+void
+XvcServer::watchDrv()
+{
+struct epoll_event ev;
+bool               want = owner_ && owner_->conn_->pending();
+
+	if ( drvFd_ < 0 || want == drvArmed_ ) {
+		return;
+	}
+	// level-triggered; stale replies must not wake us up while
+	// nothing is in flight
+	ev.events   = want ? (uint32_t)EPOLLIN : 0;
+	ev.data.ptr = this;
+	if ( epoll_ctl( epfd_, EPOLL_CTL_MOD, drvFd_, &ev ) ) {
+		throw SysErr("Unable to modify epoll set (driver)");
+	}
+	drvArmed_ = want;
+}
+
+void
+XvcServer::pollDrv()
+{
+Client *c = owner_;
+
+	// only the owner has chunks in flight
+	if ( ! c || ! c->conn_->pending() ) {
+		return;
+	}
+	if ( process( c ) ) {
+		update( c );
+		release( c );
+	} else {
+		release( 0 );
+	}
+}
+
+void
+XvcServer::service(Client *c, uint32_t events)
+{
+	if ( ! c->conn_ ) {
+		// closed already
+		return;
+	}
+
+	try {
+		if ( events & EPOLLOUT ) {
+			c->conn_->onWritable();
+		}
+		if ( events & (EPOLLIN | EPOLLHUP | EPOLLERR) ) {
+			c->conn_->onReadable();
+		}
+	} catch (SysErr &e) {
+		close( c, e.what() );
+		release( 0 );
+		return;
+	}
+
+	if ( grant( c ) ) {
+		if ( ! process( c ) ) {
+			release( 0 );
+			return;
+		}
+	}
+	update( c );
+	release( c );
+}
+
+void
+XvcServer::run()
+{
+struct epoll_event evs[16];
+int                n, i, tmo;
+bool               drvEv;
+
+	owner_ = 0;
+	done_  = false;
+
+	if ( pipelined_ && ! pipe_ ) {
+		pipe_       = new XvcPipeline( drv_, drvCpu_ );
+		evs[0].events   = EPOLLIN;
+		evs[0].data.ptr = pipe_;
+		if ( epoll_ctl( epfd_, EPOLL_CTL_ADD, pipe_->getFd(), &evs[0] ) ) {
+			throw SysErr("Unable to add pipeline to epoll set");
+		}
+	}
+
+	if ( async_ && drvFd_ < 0 ) {
+		if ( (drvFd_ = drv_->asyncVectors()) < 0 ) {
+			fprintf(stderr,"Warning: driver does not support event-driven completion; using blocking mode\n");
+			async_ = false;
+		} else {
+			// armed by 'watchDrv()'
+			evs[0].events   = 0;
+			evs[0].data.ptr = this;
+			if ( epoll_ctl( epfd_, EPOLL_CTL_ADD, drvFd_, &evs[0] ) ) {
+				throw SysErr("Unable to add driver to epoll set");
+			}
+		}
+	}
+
+	while ( ! done_ ) {
+		tmo = timeout();
+		if ( pipe_ && ! pipe_->sleep() ) {
+			// completed chunks are waiting
+			tmo = 0;
+		}
+		n = epoll_wait( epfd_, evs, sizeof(evs)/sizeof(evs[0]), tmo );
+		if ( pipe_ ) {
+			pipe_->awake();
+		}
+		if ( n < 0 ) {
+			if ( EINTR == errno ) {
+				continue;
+			}
+			throw SysErr("epoll_wait failed");
+		}
+		if ( 0 == n && owner_ ) {
+			// the owner's slice expired while it was idle
+			release( owner_ );
+		}
+		// a timeout may also be the driver's
+		drvEv = ( 0 == n );
+		for ( i = 0; i < n && ! done_; i++ ) {
+			if ( ! evs[i].data.ptr ) {
+				accept();
+			} else if ( evs[i].data.ptr == this ) {
+				drvEv = true;
+			} else if ( evs[i].data.ptr != pipe_ ) {
+				service( (Client*)evs[i].data.ptr, evs[i].events );
+			}
+		}
+		if ( pipe_ && ! done_ ) {
+			complete();
+		}
+		if ( drvEv && drvArmed_ && ! done_ ) {
+			pollDrv();
+		}
+		if ( ! done_ ) {
+			watchDrv();
+		}
+		while ( ! dead_.empty() ) {
+			delete dead_.back();
+			dead_.pop_back();
+		}
+	}
+}
+
+static void
+usage(const char *nm)
+{
+DriverRegistry *registry = DriverRegistry::get();
+
+	fprintf(stderr,"Usage: %s [-v{v}] [-Vhosg] [-S <bits>] [-D <driver>] [-p <port>] [-M <bytes>] [-T <mode>] [-P <port>|</path>] [-r <file> [-B <MB>]] [-R <file> [-O]] [-q <ms>] [-C <ms>] [-j|-a] [-c <io_cpu>,<drv_cpu>] -t <target> | -x <port>,<target>[,<driver>]... [ -- <driver_options>]\n", nm);
+	fprintf(stderr,"  -t <target> : contact target (depends on driver; e.g., <ip[:port]>)\n");
+	fprintf(stderr,"  -h          : this message\n");
+	fprintf(stderr,"  -D <driver> : use transport driver 'driver'\n");
+	fprintf(stderr,"                   built-in drivers:\n");
+	registry->printRegisteredDrivers(stderr, "                   '%s'\n");
+	fprintf(stderr,"                   'udpLoopback'\n");
+	fprintf(stderr,"                the default driver is: '%s'\n", DEFAULTDRVNAME);
+	fprintf(stderr,"  -p <port>   : bind to TCP port <port> (default: 2542)\n");
+	fprintf(stderr,"  -M <bytes>  : max XVC vector size (default 32768)\n");
+	fprintf(stderr,"  -v          : verbose (more 'v's increase verbosity)\n");
+	fprintf(stderr,"  -s          : sniff; decode the JTAG traffic (in the background)\n");
+	fprintf(stderr,"  -S <bits>   : sniffer prints at most <bits> of every register (default 64;\n");
+	fprintf(stderr,"                0: everything)\n");
+	fprintf(stderr,"  -g          : profile the JTAG traffic (where the TCK cycles go); a summary\n");
+	fprintf(stderr,"                is printed when a client disconnects (also: metrics)\n");
+	fprintf(stderr,"  -V          : print version information\n");
+	fprintf(stderr,"  -T <mode>   : set test mode/flags (1: drop a packet now and then; 2: the\n");
+	fprintf(stderr,"                loopback emulations forget their macros now and then)\n");
+	fprintf(stderr,"  -o          : exit once the client holding the TAP disconnects (and no\n");
+	fprintf(stderr,"                other client is waiting for it)\n");
+	fprintf(stderr,"  -P <port>   : export metrics (prometheus text format) on TCP <port> (localhost only)\n");
+	fprintf(stderr,"  -P </path>  : export metrics on UNIX socket </path> (must contain a '/')\n");
+	fprintf(stderr,"                Metrics are also dumped to stderr on SIGUSR1.\n");
+	fprintf(stderr,"  -r <file>   : record the session(s) into a ring buffer mapped to <file>\n");
+	fprintf(stderr,"  -B <MB>     : size of the recording ring buffer (default 16MB)\n");
+	fprintf(stderr,"  -R <file>   : replay the XVC commands recorded in <file> against the\n");
+	fprintf(stderr,"                driver (as fast as possible) and report latencies\n");
+	fprintf(stderr,"  -O          : replay with the original timing\n");
+	fprintf(stderr,"  -x <port>,<target>[,<driver>]\n");
+	fprintf(stderr,"              : serve <target> on TCP <port> (using <driver>; default: -D);\n");
+	fprintf(stderr,"                may be given multiple times to serve many targets from one\n");
+	fprintf(stderr,"                process. The driver options (after '--') apply to all targets.\n");
+	fprintf(stderr,"  -j          : use a separate thread for the driver (two-stage pipeline)\n");
+	fprintf(stderr,"  -a          : event-driven driver: never block the server waiting for the\n");
+	fprintf(stderr,"                target (if the driver supports it; ignored with -j)\n");
+	fprintf(stderr,"  -c <io_cpu>,<drv_cpu>\n");
+	fprintf(stderr,"              : pin the I/O (server) and driver threads to CPUs (-1: don't pin)\n");
+	fprintf(stderr,"  -q <ms>     : time slice (default 100ms) after which a client passes the\n");
+	fprintf(stderr,"                target on to a waiting client (at the next safe point)\n");
+	fprintf(stderr,"  -C <ms>     : reuse the target's parameters (word size, memory depth, ...)\n");
+	fprintf(stderr,"                for <ms> (default 10000; 0: query the target on every\n");
+	fprintf(stderr,"                connection). Errors and SIGHUP make xvcSrv query again. Not\n");
+	fprintf(stderr,"                used with the loopback drivers.\n");
+}
+
+static void *
 udpTestThread(void *arg)
 {
 UdpLoopBack *loop = (UdpLoopBack*) arg;
 
-	loop->setTestMode( 1 );
-
 	loop->run();
 
 	return 0;
 }
 
+// A target served in '-x' mode; every target has its own driver,
+// listener and thread.
+struct XvcTarget {
+	unsigned          port_;
+	const char       *target_;
+	const char       *drvnam_;
+	JtagDriver       *drv_;
+	XvcServer        *srv_;
+	pthread_t         tid_;
+	unsigned          debug_;
+	bool              setTest_;
+	unsigned          testMode_;
+	unsigned          queryTtl_;
+	int               ioCpu_;
+};
+
+// parse '<port>,<target>[,<driver>]'
+static bool
+parseTarget(XvcTarget *t, char *spec)
+{
+char *c;
+
+	if ( ! (c = strchr( spec, ',' )) ) {
+		return false;
+	}
+	*c++ = 0;
+	if ( 1 != sscanf( spec, "%i", &t->port_ ) || t->port_ > 65535 ) {
+		return false;
+	}
+	t->target_ = c;
+	t->drvnam_ = 0;
+	if ( (c = strchr( c, ',' )) ) {
+		*c++       = 0;
+		t->drvnam_ = c;
+	}
+	return 0 != *t->target_;
+}
+
+static void *
+targetThread(void *arg)
+{
+XvcTarget *t = (XvcTarget*) arg;
+
+	// initialize in parallel; a target which is slow to respond
+	// (or down) does not delay the others
+	try {
+		t->drv_->setDebug( t->debug_ );
+		t->drv_->setQueryTtl( t->queryTtl_ );
+		t->drv_->init();
+
+		if ( t->setTest_ ) {
+			t->drv_->setTestMode( t->testMode_ );
+		}
+
+		if ( t->drv_->getDebug() > 0 ) {
+			t->drv_->dumpInfo();
+		}
+
+		XvcPipeline::pin( pthread_self(), t->ioCpu_ );
+
+		t->srv_->run();
+	} catch ( std::runtime_error &e ) {
+		fprintf(stderr, "Target '%s' (port %u): %s\n", t->target_, t->port_, e.what());
+	}
+	return 0;
+}
+
 DriverRegistry::DriverRegistry()
 {
 }
@@ -633,6 +2089,34 @@ DriverRegistry::has(const char *drvnam)
 	return !! find( drvnam );
 }
 
+const char *
+DriverRegistry::load(const char *drvnam)
+{
+unsigned long n = entries_.size();
+unsigned      i;
+Loaded        l;
+
+	if ( has( drvnam ) ) {
+		return drvnam;
+	}
+	// loading the same object again does not register another driver
+	for ( i = 0; i < loaded_.size(); i++ ) {
+		if ( loaded_[i].path_ == drvnam ) {
+			return loaded_[i].name_;
+		}
+	}
+	if ( ! dlopen( drvnam, RTLD_NOW | RTLD_GLOBAL ) ) {
+		throw std::runtime_error(std::string("Unable to load requested driver: ") + std::string(dlerror()));
+	}
+	if ( entries_.size() == n ) {
+		throw std::runtime_error(std::string("No driver registered by: ") + std::string(drvnam));
+	}
+	l.path_ = drvnam;
+	l.name_ = entries_.back().name_;
+	loaded_.push_back( l );
+	return l.name_;
+}
+
 void
 DriverRegistry::printRegisteredDrivers(FILE *f, const char *fmt)
 {
@@ -703,7 +2187,6 @@ const char     *drvnam   = DEFAULTDRVNAME;
 unsigned        port     = 2542;
 unsigned       *i_p      = 0;
 JtagDriver     *drv      = 0;
-void           *hdl;
 UdpLoopBack    *loop     = 0;
 pthread_t       loopT;
 unsigned        maxMsg   = 32768;
@@ -712,8 +2195,25 @@ bool            setTest  = false;
 unsigned        testMode = 0;
 bool            once     = false;
 bool            help     = false;
-
-	while ( (opt = getopt(argc, argv, "hvVost:D:p:M:T:")) > 0 ) {
+const char     *metrics  = 0;
+const char     *recFile  = 0;
+const char     *replay   = 0;
+bool            timed    = false;
+unsigned        recMB    = 16;
+unsigned        sliceMs  = 100;
+unsigned        queryTtl = 10000;
+unsigned        snifBits = 64;
+bool            piped    = false;
+bool            async    = false;
+bool            profile  = false;
+int             ioCpu    = -1;
+int             drvCpu   = -1;
+vector<XvcTarget> targets;
+XvcTarget       tgt;
+int             drvOptind;
+unsigned        i;
+
+	while ( (opt = getopt(argc, argv, "hvVosS:t:D:p:M:T:P:r:B:R:Oq:C:x:jc:ag")) > 0 ) {
         i_p = 0;
 		switch ( opt ) {
 			default:
@@ -740,6 +2240,14 @@ bool            help     = false;
 				debug |= 0x100;
 				break;
 
+			case 'S':
+				i_p = &snifBits;
+				break;
+
+			case 'g':
+				profile = true;
+				break;
+
 			case 'D':
 				drvnam = optarg;
 				break;
@@ -760,6 +2268,57 @@ bool            help     = false;
 			case 'o':
 				once = true;
 				break;
+
+			case 'P':
+				metrics = optarg;
+				break;
+
+			case 'r':
+				recFile = optarg;
+				break;
+
+			case 'B':
+				i_p = &recMB;
+				break;
+
+			case 'R':
+				replay = optarg;
+				break;
+
+			case 'O':
+				timed = true;
+				break;
+
+			case 'q':
+				i_p = &sliceMs;
+				break;
+
+			case 'C':
+				i_p = &queryTtl;
+				break;
+
+			case 'x':
+				if ( ! parseTarget( &tgt, optarg ) ) {
+					fprintf(stderr,"Invalid target spec (need <port>,<target>[,<driver>]): %s\n", optarg);
+					return 1;
+				}
+				targets.push_back( tgt );
+				break;
+
+			case 'j':
+				piped = true;
+				break;
+
+			case 'a':
+				async = true;
+				break;
+
+			case 'c':
+				if ( 2 != sscanf( optarg, "%i,%i", &ioCpu, &drvCpu ) ) {
+					fprintf(stderr,"Unable to scan arg for option '-c' (need <io_cpu>,<drv_cpu>): %s\n", optarg);
+					return 1;
+				}
+				break;
 		}
 		if ( i_p && 1 != sscanf(optarg, "%i", i_p) ) {
 			fprintf(stderr,"Unable to scan arg for option '-%c': %s\n", opt, optarg);
@@ -770,6 +2329,49 @@ bool            help     = false;
     // Reset opterr so that drivers can parse options after '--'
 	opterr = 0;
 
+	JtagDumpCtx::setDefaultPrintBits( snifBits );
+
+	signal( SIGHUP, onHup );
+
+	if ( ! targets.empty() && ! help ) {
+		if ( target || replay || recFile || 0 == strcmp( drvnam, "udpLoopback" ) ) {
+			fprintf(stderr,"-x cannot be combined with -t, -r, -R or the 'udpLoopback' driver\n");
+			return 1;
+		}
+		drvOptind = optind;
+		try {
+			for ( i = 0; i < targets.size(); i++ ) {
+				targets[i].drvnam_   = registry->load( targets[i].drvnam_ ? targets[i].drvnam_ : drvnam );
+				// every driver parses the options after '--'
+				optind               = drvOptind;
+				targets[i].drv_      = registry->create( targets[i].drvnam_, argc, argv, targets[i].target_ );
+				// bind all ports now so that a conflict is reported right away
+				targets[i].srv_      = new XvcServer( targets[i].port_, targets[i].drv_, debug, maxMsg, once, sliceMs, piped, drvCpu, async, profile );
+				targets[i].debug_    = debug;
+				targets[i].setTest_  = setTest;
+				targets[i].testMode_ = testMode;
+				targets[i].queryTtl_ = queryTtl;
+				targets[i].ioCpu_    = ioCpu;
+			}
+			// must be started before any other thread
+			XvcMetrics::start( metrics );
+		} catch ( std::runtime_error &e ) {
+			fprintf(stderr, "%s\n", e.what());
+			return 1;
+		}
+
+		for ( i = 0; i < targets.size(); i++ ) {
+			if ( pthread_create( &targets[i].tid_, 0, targetThread, &targets[i] ) ) {
+				perror("Unable to launch target thread");
+				return 1;
+			}
+		}
+		for ( i = 0; i < targets.size(); i++ ) {
+			pthread_join( targets[i].tid_, 0 );
+		}
+		return 0;
+	}
+
 	try {
 		if ( 0 == strcmp( drvnam, "udpLoopback" ) ) {
 			if ( help ) {
@@ -779,12 +2381,7 @@ bool            help     = false;
 			drv  = new JtagDriverUdp( argc, argv, "localhost:2543" );
 			loop = new UdpLoopBack( target, 2543 );
 		} else {
-			if ( ! registry->has( drvnam ) ) {	
-				if ( ! (hdl = dlopen( drvnam, RTLD_NOW | RTLD_GLOBAL )) ) {
-					throw std::runtime_error(std::string("Unable to load requested driver: ") + std::string(dlerror()));
-				}
-				drvnam = 0;
-			}
+			drvnam = registry->load( drvnam );
 		}
 		if ( help ) {
 			registry->usage( drvnam );
@@ -808,10 +2405,20 @@ bool            help     = false;
 		return 1;
 	}
 
+	// must be started before any other thread
+	try {
+		XvcMetrics::start( metrics );
+	} catch ( std::runtime_error &e ) {
+		fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+
 	// must fire up the loopback UDP (FW emulation) first
 	if ( loop ) {
 
 		loop->setDebug( debug );
+		// the emulation always drops packets now and then
+		loop->setTestMode( 1 | (setTest ? testMode : 0) );
 		loop->init();
 
 		if ( pthread_create( &loopT, 0, udpTestThread, loop ) ) {
@@ -821,6 +2428,8 @@ bool            help     = false;
 
 
 	drv->setDebug( debug );
+	// the UDP loopback starts over when queried, i.e., for every connection
+	drv->setQueryTtl( loop ? 0 : queryTtl );
 	// initialize fully constructed object
 	drv->init();
 
@@ -833,7 +2442,34 @@ bool            help     = false;
 		drv->dumpInfo();
 	}
 
-XvcServer s(port, drv, debug, maxMsg, once);
+	try {
+		if ( replay ) {
+			XvcReplay r( drv, replay, timed, maxMsg );
+			r.run( stdout );
+			return 0;
+		}
+
+		if ( recFile ) {
+			XvcRecorder::start( recFile, ((unsigned long)recMB) << 20 );
+		}
+	} catch ( std::runtime_error &e ) {
+		fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+
+XvcServer s(port, drv, debug, maxMsg, once, sliceMs, piped, drvCpu, async, profile);
+
+	try {
+		XvcPipeline::pin( pthread_self(), ioCpu );
+	} catch ( std::runtime_error &e ) {
+		fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
 
 	s.run();
+
+	// flushes the sniffer
+	delete drv;
+
+	return 0;
 }
@@ -18,15 +18,77 @@
 #define XVC_SRV_H
 
 #include <xvcDriver.h>
+#include <jtagDump.h>
+#include <deque>
+
+class XvcConn;
+class XvcPipeline;
 
 // XVC Server (top) class
+//
+// Services any number of XVC connections from a single thread (epoll).
+// The driver is granted to one connection at a time. The owner keeps
+// it until other clients are waiting, its time slice has expired and
+// it is at a safe point, i.e., between commands with the TAP in
+// Test-Logic-Reset or Run-Test/Idle (the server tracks the TAP state).
 class XvcServer {
 private:
-	SockSd            sock_;
-	JtagDriver       *drv_;
-	unsigned          debug_;
-	unsigned          maxMsgSize_;
-	bool              once_;
+	struct Client {
+		XvcConn      *conn_;
+		bool          waiting_;
+		uint64_t      waitSince_;
+		unsigned long grants_;
+		uint64_t      waitTot_;
+		uint64_t      waitMax_;
+	};
+
+	SockSd               sock_;
+	JtagDriver          *drv_;
+	unsigned             debug_;
+	unsigned             maxMsgSize_;
+	bool                 once_;
+	int                  epfd_;
+	Client              *owner_;
+	std::deque<Client*>  waitq_;
+	vector<Client*>      dead_;
+	bool                 done_;
+	JtagDumpCtx          tap_;
+	uint64_t             slice_;
+	uint64_t             grantedAt_;
+	bool                 pipelined_;
+	int                  drvCpu_;
+	XvcPipeline         *pipe_;
+	// event-driven driver completion
+	bool                 async_;
+	int                  drvFd_;
+	bool                 drvArmed_;
+	bool                 profile_;
+	// SIGHUPs seen so far (see 'accept()')
+	int                  hups_;
+
+	virtual void         accept();
+	virtual void         update(Client *c);
+	virtual void         close(Client *c, const char *why);
+	// may 'c' use the driver? Queues 'c' if not.
+	virtual bool         grant(Client *c);
+	// process input of 'c'; returns false if the connection was closed
+	virtual bool         process(Client *c);
+	// make 'c' the owner
+	virtual void         assign(Client *c);
+	// pass the driver on if 'c' may give it up ('c' == NULL: there
+	// is no owner)
+	virtual void         release(Client *c);
+	// epoll timeout (ms) until the owner's slice expires or the
+	// driver needs attention
+	virtual int          timeout();
+	// hand chunks completed by the driver thread to the owner
+	virtual void         complete();
+	// (async mode) watch the driver's descriptor while the owner
+	// has chunks in flight
+	virtual void         watchDrv();
+	// (async mode) the driver is ready or its timeout expired
+	virtual void         pollDrv();
+	virtual void         service(Client *c, uint32_t events);
 
 public:
 	XvcServer(
@@ -34,14 +96,21 @@ public:
 		JtagDriver *drv,
 		unsigned debug=0,
 		unsigned maxMsgSize = 32768,
-		bool once = false
+		bool once = false,
+		unsigned sliceMs = 100,
+		// use a separate driver thread (pinned to 'drvCpu' unless negative)
+		bool pipelined = false,
+		int  drvCpu = -1,
+		// complete driver transfers from the event loop (never block
+		// waiting for the target); ignored if 'pipelined'
+		bool async = false,
+		// profile the JTAG traffic of every connection
+		bool profile = false
 	);
 
 	virtual void run();
 
-	virtual ~XvcServer()
-	{
-	};
+	virtual ~XvcServer();
 };
 
 #endif
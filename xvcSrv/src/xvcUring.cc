@@ -0,0 +1,343 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#include <xvcUring.h>
+#include <xvcDriver.h>
+
+#ifdef XVC_HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <stdlib.h>
+
+// tags (upper 32 bits of 'user_data'); the lower bits hold the length
+// of a send.
+#define TAG_SEND    1ULL
+#define TAG_RECV    2ULL
+#define TAG_TIMEOUT 3ULL
+
+bool
+XvcUring::isAvailable()
+{
+	return true;
+}
+
+XvcUring::XvcUring(int sd, unsigned entries)
+: fd_        ( -1 ),
+  sqMap_     ( 0  ),
+  sqMapSz_   ( 0  ),
+  cqMap_     ( 0  ),
+  cqMapSz_   ( 0  ),
+  sqes_      ( 0  ),
+  sqesSz_    ( 0  ),
+  toSubmit_  ( 0  ),
+  inFlight_  ( 0  ),
+  sendErr_   ( 0  ),
+  sendErrLen_( 0  ),
+  enters_    ( 0  )
+{
+struct io_uring_params  p;
+struct io_uring_probe  *probe;
+unsigned long           probeSz;
+static const uint8_t    ops[] = { IORING_OP_SEND, IORING_OP_RECVMSG, IORING_OP_LINK_TIMEOUT };
+unsigned                i;
+void                   *m;
+
+	memset( &p, 0, sizeof(p) );
+	if ( (fd_ = syscall( __NR_io_uring_setup, entries, &p )) < 0 ) {
+		throw SysErr("XvcUring: io_uring_setup failed");
+	}
+	entries_ = p.sq_entries;
+	tail_    = 0;
+
+	sqMapSz_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cqMapSz_ = p.cq_off.cqes  + p.cq_entries * sizeof(struct io_uring_cqe);
+
+	if ( (p.features & IORING_FEAT_SINGLE_MMAP) ) {
+		if ( cqMapSz_ > sqMapSz_ ) {
+			sqMapSz_ = cqMapSz_;
+		}
+		cqMapSz_ = 0;
+	}
+
+	m = mmap( 0, sqMapSz_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING );
+	if ( MAP_FAILED == m ) {
+		cleanup();
+		throw SysErr("XvcUring: unable to map SQ ring");
+	}
+	sqMap_ = m;
+
+	if ( cqMapSz_ ) {
+		m = mmap( 0, cqMapSz_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING );
+		if ( MAP_FAILED == m ) {
+			cleanup();
+			throw SysErr("XvcUring: unable to map CQ ring");
+		}
+		cqMap_ = m;
+	} else {
+		cqMap_ = sqMap_;
+	}
+
+	sqesSz_ = p.sq_entries * sizeof(struct io_uring_sqe);
+	m = mmap( 0, sqesSz_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES );
+	if ( MAP_FAILED == m ) {
+		cleanup();
+		throw SysErr("XvcUring: unable to map SQEs");
+	}
+	sqes_ = m;
+
+	sqHead_  = (unsigned*)((uint8_t*)sqMap_ + p.sq_off.head);
+	sqTail_  = (unsigned*)((uint8_t*)sqMap_ + p.sq_off.tail);
+	sqMask_  = (unsigned*)((uint8_t*)sqMap_ + p.sq_off.ring_mask);
+	sqArray_ = (unsigned*)((uint8_t*)sqMap_ + p.sq_off.array);
+	cqHead_  = (unsigned*)((uint8_t*)cqMap_ + p.cq_off.head);
+	cqTail_  = (unsigned*)((uint8_t*)cqMap_ + p.cq_off.tail);
+	cqMask_  = (unsigned*)((uint8_t*)cqMap_ + p.cq_off.ring_mask);
+	cqes_    = (uint8_t*)cqMap_ + p.cq_off.cqes;
+
+	// make sure the kernel supports what we need
+	probeSz = sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op);
+	probe   = (struct io_uring_probe*)calloc( 1, probeSz );
+	if ( ! probe ) {
+		cleanup();
+		throw std::runtime_error("XvcUring: no memory");
+	}
+	if ( syscall( __NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, 256 ) < 0 ) {
+		free( probe );
+		cleanup();
+		throw SysErr("XvcUring: unable to probe supported operations");
+	}
+	for ( i = 0; i < sizeof(ops)/sizeof(ops[0]); i++ ) {
+		if ( ops[i] > probe->last_op || ! (probe->ops[ ops[i] ].flags & IO_URING_OP_SUPPORTED) ) {
+			free( probe );
+			cleanup();
+			throw std::runtime_error("XvcUring: kernel lacks required io_uring operations");
+		}
+	}
+	free( probe );
+
+	// saves the kernel a file lookup per operation
+	if ( syscall( __NR_io_uring_register, fd_, IORING_REGISTER_FILES, &sd, 1 ) < 0 ) {
+		cleanup();
+		throw SysErr("XvcUring: unable to register socket");
+	}
+}
+
+void
+XvcUring::cleanup()
+{
+	if ( sqes_ ) {
+		munmap( sqes_, sqesSz_ );
+	}
+	if ( cqMap_ && cqMap_ != sqMap_ ) {
+		munmap( cqMap_, cqMapSz_ );
+	}
+	if ( sqMap_ ) {
+		munmap( sqMap_, sqMapSz_ );
+	}
+	if ( fd_ >= 0 ) {
+		::close( fd_ );
+	}
+	sqes_  = 0;
+	cqMap_ = 0;
+	sqMap_ = 0;
+	fd_    = -1;
+}
+
+XvcUring::~XvcUring()
+{
+	cleanup();
+}
+
+// make sure there are 'n' free SQEs (a linked pair must not be split)
+void
+XvcUring::makeRoom(unsigned n)
+{
+	if ( tail_ - __atomic_load_n( sqHead_, __ATOMIC_ACQUIRE ) + n > entries_ ) {
+		// push out what we have (without waiting)
+		enter( 0 );
+		reap( 0 );
+	}
+}
+
+void *
+XvcUring::getSqe()
+{
+struct io_uring_sqe *sqe;
+unsigned             idx = tail_ & *sqMask_;
+
+	sqe = (struct io_uring_sqe*)sqes_ + idx;
+	memset( sqe, 0, sizeof(*sqe) );
+	sqArray_[ idx ] = idx;
+	tail_++;
+	// published by 'enter()'
+	toSubmit_++;
+	return sqe;
+}
+
+void
+XvcUring::enter(unsigned waitFor)
+{
+int r;
+
+	// make the new SQEs visible to the kernel
+	__atomic_store_n( sqTail_, tail_, __ATOMIC_RELEASE );
+
+	do {
+		enters_++;
+		r = syscall( __NR_io_uring_enter, fd_, toSubmit_, waitFor, waitFor ? IORING_ENTER_GETEVENTS : 0, 0, 0 );
+		if ( r < 0 ) {
+			if ( EINTR == errno || EAGAIN == errno || EBUSY == errno ) {
+				continue;
+			}
+			throw SysErr("XvcUring: io_uring_enter failed");
+		}
+		inFlight_ += r;
+		toSubmit_ -= r;
+	} while ( toSubmit_ > 0 || __atomic_load_n( cqTail_, __ATOMIC_ACQUIRE ) - *cqHead_ < waitFor );
+}
+
+void
+XvcUring::reap(int *recvRes)
+{
+unsigned             head = *cqHead_;
+unsigned             tail = __atomic_load_n( cqTail_, __ATOMIC_ACQUIRE );
+struct io_uring_cqe *cqe;
+
+	while ( head != tail ) {
+		cqe = (struct io_uring_cqe*)cqes_ + (head & *cqMask_);
+		switch ( cqe->user_data >> 32 ) {
+			case TAG_SEND:
+				if ( cqe->res < 0 && 0 == sendErr_ ) {
+					sendErr_    = cqe->res;
+					sendErrLen_ = (unsigned)cqe->user_data;
+				}
+				break;
+
+			case TAG_RECV:
+				if ( recvRes ) {
+					*recvRes = cqe->res;
+				}
+				break;
+
+			default:
+				break;
+		}
+		inFlight_--;
+		head++;
+	}
+	__atomic_store_n( cqHead_, head, __ATOMIC_RELEASE );
+}
+
+void
+XvcUring::send(const void *buf, unsigned len)
+{
+struct io_uring_sqe *sqe;
+
+	makeRoom( 1 );
+	sqe = (struct io_uring_sqe*)getSqe();
+	sqe->opcode    = IORING_OP_SEND;
+	sqe->flags     = IOSQE_FIXED_FILE;
+	sqe->fd        = 0;
+	sqe->addr      = (unsigned long)buf;
+	sqe->len       = len;
+	sqe->user_data = (TAG_SEND << 32) | len;
+}
+
+int
+XvcUring::recv(struct msghdr *msg, unsigned long us)
+{
+struct io_uring_sqe      *sqe;
+struct __kernel_timespec  ts;
+int                       res = -ECANCELED;
+
+	makeRoom( 2 );
+	sqe = (struct io_uring_sqe*)getSqe();
+	sqe->opcode     = IORING_OP_RECVMSG;
+	sqe->flags      = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+	sqe->fd         = 0;
+	sqe->addr       = (unsigned long)msg;
+	sqe->len        = 1;
+	// report the real length of a truncated datagram
+	sqe->msg_flags  = MSG_TRUNC;
+	sqe->user_data  = TAG_RECV << 32;
+
+	// the kernel copies the timeout when the SQE is submitted
+	ts.tv_sec       = us / 1000000;
+	ts.tv_nsec      = (us % 1000000) * 1000;
+
+	sqe = (struct io_uring_sqe*)getSqe();
+	sqe->opcode     = IORING_OP_LINK_TIMEOUT;
+	sqe->addr       = (unsigned long)&ts;
+	sqe->len        = 1;
+	sqe->user_data  = TAG_TIMEOUT << 32;
+
+	// wait for everything (sends, receive and the timeout which
+	// completes - cancelled - along with the receive)
+	enter( inFlight_ + toSubmit_ );
+	reap( &res );
+
+	return -ECANCELED == res ? -ETIME : res;
+}
+
+int
+XvcUring::getSendErr(unsigned *len)
+{
+int err = sendErr_;
+
+	if ( len ) {
+		*len = sendErrLen_;
+	}
+	sendErr_ = 0;
+	return err;
+}
+
+#else /* ! XVC_HAVE_IO_URING */
+
+bool
+XvcUring::isAvailable()
+{
+	return false;
+}
+
+XvcUring::XvcUring(int, unsigned)
+{
+	throw std::runtime_error("XvcUring: io_uring support not compiled in");
+}
+
+XvcUring::~XvcUring()
+{
+}
+
+void
+XvcUring::send(const void *, unsigned)
+{
+}
+
+int
+XvcUring::recv(struct msghdr *, unsigned long)
+{
+	return -ENOSYS;
+}
+
+int
+XvcUring::getSendErr(unsigned *)
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,101 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#ifndef XVC_URING_H
+#define XVC_URING_H
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+// Minimal io_uring for a connected datagram socket.
+//
+// Sends are merely queued; 'recv()' submits them together with a receive
+// and a (linked) timeout and waits for everything with a single system
+// call. Thus, a firmware round trip costs one 'io_uring_enter()' instead
+// of write + poll + read.
+//
+// Uses the kernel interface directly (no liburing needed); compiled in if
+// the kernel headers provide <linux/io_uring.h> (XVC_HAVE_IO_URING). The
+// constructor throws if io_uring is not supported (or not permitted) at
+// run-time and the caller is expected to fall back to plain system calls.
+class XvcUring {
+private:
+	int               fd_;
+	void             *sqMap_;
+	unsigned long     sqMapSz_;
+	void             *cqMap_;
+	unsigned long     cqMapSz_;
+	void             *sqes_;
+	unsigned long     sqesSz_;
+
+	unsigned         *sqHead_;
+	unsigned         *sqTail_;
+	unsigned         *sqMask_;
+	unsigned         *sqArray_;
+	unsigned         *cqHead_;
+	unsigned         *cqTail_;
+	unsigned         *cqMask_;
+	void             *cqes_;
+
+	unsigned          entries_;
+	// next free SQE
+	unsigned          tail_;
+	// prepared but not yet submitted
+	unsigned          toSubmit_;
+	// submitted but not yet completed
+	unsigned          inFlight_;
+	// first send which failed since the last 'getSendErr()'
+	int               sendErr_;
+	unsigned          sendErrLen_;
+
+	unsigned long     enters_;
+
+	XvcUring(const XvcUring &);
+	XvcUring & operator=(const XvcUring &);
+
+	void              makeRoom(unsigned n);
+	void             *getSqe();
+	void              enter(unsigned waitFor);
+	void              reap(int *recvRes);
+	void              cleanup();
+
+public:
+	// 'sd' is registered as a fixed file
+	XvcUring(int sd, unsigned entries = 64);
+
+	// false if not compiled in
+	static bool       isAvailable();
+
+	// queue a datagram
+	virtual void      send(const void *buf, unsigned len);
+
+	// submit queued sends and receive a datagram (or time out after 'us').
+	// Returns the size of the datagram (which was truncated if this
+	// exceeds the buffers described by 'msg'), -ETIME on timeout or
+	// another -errno.
+	// If a queued send failed then 'getSendErr()' tells which.
+	virtual int       recv(struct msghdr *msg, unsigned long us);
+
+	// -errno of the first send that failed since the last call (or 0)
+	// and the length of that datagram.
+	virtual int       getSendErr(unsigned *len = 0);
+
+	virtual unsigned long getEnters() { return enters_; }
+
+	virtual ~XvcUring();
+};
+
+#endif
@@ -0,0 +1,101 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description: Benchmark/verify the TMS/TDI interleave kernels
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'SLAC Firmware Standard Library', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#include <xvcInterleave.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+static double
+now()
+{
+struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return (double)t.tv_sec + (double)t.tv_nsec * 1.0E-9;
+}
+
+// returns GB/s of TMS+TDI input consumed
+static double
+bench(JtagInterleaver::Kernel k, uint8_t *dst, const uint8_t *tms, const uint8_t *tdi, unsigned long bytes, unsigned wsz, unsigned iter)
+{
+double   then;
+unsigned i;
+
+	then = now();
+	for ( i = 0; i < iter; i++ ) {
+		k( dst, tms, tdi, bytes/wsz, wsz );
+		__asm__ __volatile__("" ::: "memory");
+	}
+	return 2.0 * (double)bytes * (double)iter / (now() - then) / 1.0E9;
+}
+
+int
+main(int argc, char **argv)
+{
+unsigned long         bytes = 32768; // XVC vector size
+unsigned              iter  = 20000;
+const unsigned        wszs[] = { 4, 8, 16 };
+std::vector<uint8_t>  tms( bytes ), tdi( bytes ), ref( 2*bytes ), dst( 2*bytes );
+unsigned              i, j;
+int                   rval  = 0;
+
+	if ( argc > 1 ) {
+		iter = strtoul( argv[1], 0, 0 );
+	}
+
+	for ( i = 0; i < bytes; i++ ) {
+		tms[i] = random();
+		tdi[i] = random();
+	}
+
+	printf("%lu byte vectors; GB/s of TMS+TDI consumed\n", bytes);
+	printf("%-4s %-10s %10s  %-10s %10s  %-10s %10s\n", "wsz", "loop", "GB/s", "scalar", "GB/s", "best", "GB/s");
+
+	for ( j = 0; j < sizeof(wszs)/sizeof(wszs[0]); j++ ) {
+		unsigned                wsz = wszs[j];
+		const char             *snam, *bnam;
+		JtagInterleaver::Kernel s = JtagInterleaver::getScalar( wsz, &snam );
+		JtagInterleaver::Kernel b = JtagInterleaver::get      ( wsz, &bnam );
+		double                  gr, gs, gb;
+
+		// verify against the generic (original) loop, using an odd number of words
+		// so that the tail handling is exercised as well.
+		memset( &ref[0], 0, ref.size() );
+		JtagInterleaver::generic( &ref[0], &tms[0], &tdi[0], bytes/wsz - 1, wsz );
+		memset( &dst[0], 0, dst.size() );
+		s( &dst[0], &tms[0], &tdi[0], bytes/wsz - 1, wsz );
+		if ( memcmp( &dst[0], &ref[0], dst.size() ) ) {
+			fprintf(stderr, "FAILED: %s kernel mismatch\n", snam);
+			rval = 1;
+		}
+		memset( &dst[0], 0, dst.size() );
+		b( &dst[0], &tms[0], &tdi[0], bytes/wsz - 1, wsz );
+		if ( memcmp( &dst[0], &ref[0], dst.size() ) ) {
+			fprintf(stderr, "FAILED: %s kernel mismatch\n", bnam);
+			rval = 1;
+		}
+
+		gr = bench( JtagInterleaver::generic, &dst[0], &tms[0], &tdi[0], bytes, wsz, iter );
+		gs = bench( s,                        &dst[0], &tms[0], &tdi[0], bytes, wsz, iter );
+		gb = bench( b,                        &dst[0], &tms[0], &tdi[0], bytes, wsz, iter );
+
+		printf("%-4u %-10s %10.2f  %-10s %10.2f  %-10s %10.2f\n", wsz, "generic", gr, snam, gs, bnam, gb);
+	}
+
+	return rval;
+}
@@ -0,0 +1,315 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description: Benchmark/verify the table-driven TAP tracker
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#include <jtagDump.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <vector>
+
+// A recorded XVC shift
+struct Shift {
+	unsigned             bits_;
+	std::vector<uint8_t> tms_;
+	std::vector<uint8_t> tdi_;
+	std::vector<uint8_t> tdo_;
+};
+
+class Gen {
+private:
+	std::vector<Shift> shifts_;
+	Shift              cur_;
+	unsigned           maxBits_;
+
+	void bit(int tms)
+	{
+		if ( cur_.bits_ % 8 == 0 ) {
+			cur_.tms_.push_back( 0 );
+			cur_.tdi_.push_back( random() );
+			cur_.tdo_.push_back( random() );
+		}
+		if ( tms ) {
+			cur_.tms_.back() |= 1 << (cur_.bits_ % 8);
+		}
+		if ( ++cur_.bits_ == maxBits_ ) {
+			flush();
+		}
+	}
+
+	void bits(int tms, unsigned n)
+	{
+		while ( n-- > 0 ) {
+			bit( tms );
+		}
+	}
+
+	// from Run-Test/Idle through a scan of 'n' bits back to Run-Test/Idle
+	void scan(bool ir, unsigned n)
+	{
+		bit( 1 );              // Select-DR
+		if ( ir ) {
+			bit( 1 );          // Select-IR
+		}
+		bit( 0 );              // Capture
+		bit( 0 );              // Shift
+		if ( n >= 4 && (random() & 1) ) {
+			// take a break in the middle
+			bits( 0, n/2 - 1 );
+			bit( 1 );          // Exit1
+			bits( 0, 3 );      // Pause
+			bit( 1 );          // Exit2
+			bit( 0 );          // Shift
+			n -= n/2;
+		}
+		bits( 0, n - 1 );
+		bit( 1 );              // Exit1
+		bit( 1 );              // Update
+		bit( 0 );              // Run-Test/Idle
+	}
+
+public:
+	Gen(unsigned maxBits)
+	: maxBits_( maxBits )
+	{
+		cur_.bits_ = 0;
+	}
+
+	void flush()
+	{
+		if ( cur_.bits_ ) {
+			shifts_.push_back( cur_ );
+			cur_.bits_ = 0;
+			cur_.tms_.clear();
+			cur_.tdi_.clear();
+			cur_.tdo_.clear();
+		}
+	}
+
+	// 'n' typical debug-hub transactions
+	void session(unsigned n, unsigned maxDR)
+	{
+		bits( 1, 5 );          // Test-Logic-Reset
+		bit( 0 );
+		while ( n-- > 0 ) {
+			scan( true, (random() % 4) ? 6 : 70 );
+			scan( false, 1 + random() % maxDR );
+			bits( 0, random() % 20 );
+			if ( 0 == random() % 8 ) {
+				// the next XVC message starts here
+				flush();
+			}
+		}
+		flush();
+	}
+
+	// random TMS; visits every state (and odd paths through them)
+	void noise(unsigned n)
+	{
+		while ( n-- > 0 ) {
+			bit( random() & 1 );
+		}
+		flush();
+	}
+
+	std::vector<Shift> &get()
+	{
+		return shifts_;
+	}
+};
+
+static double
+now()
+{
+struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return (double)t.tv_sec + (double)t.tv_nsec * 1.0E-9;
+}
+
+// the original bit-at-a-time loop
+static void
+processRef(JtagDumpCtx *c, int nbits, unsigned char *tmsb, unsigned char *tdob, unsigned char *tdib)
+{
+unsigned n,m;
+
+	while ( nbits > 0 ) {
+		n = 1 << ( nbits < 8 ? nbits : 8 );
+		for ( m = 1; m < n; m <<= 1 ) {
+			c->advance( ((*tmsb) & m), ((*tdob) & m), ((*tdib) & m) );
+		}
+		tmsb++;
+		tdob++;
+		tdib++;
+		nbits -= 8;
+	}
+}
+
+static void
+run(JtagDumpCtx *c, std::vector<Shift> &v, bool ref)
+{
+unsigned i;
+
+	for ( i = 0; i < v.size(); i++ ) {
+		if ( ref ) {
+			processRef( c, v[i].bits_, &v[i].tms_[0], &v[i].tdo_[0], &v[i].tdi_[0] );
+		} else {
+			c->processBuf( v[i].bits_, &v[i].tms_[0], &v[i].tdo_[0], &v[i].tdi_[0] );
+		}
+	}
+}
+
+static bool
+sameReg(JtagReg *a, JtagReg *b)
+{
+unsigned i;
+
+	if ( a->getLen() != b->getLen() ) {
+		return false;
+	}
+	for ( i = 0; i < a->getNumWords(); i++ ) {
+		if ( a->getWord( i ) != b->getWord( i ) ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool
+same(JtagDumpCtx *a, JtagDumpCtx *b)
+{
+	return    a->getState()->idx_ == b->getState()->idx_
+	       && sameReg( a->getDRiReg(), b->getDRiReg() )
+	       && sameReg( a->getDRoReg(), b->getDRoReg() )
+	       && sameReg( a->getIRiReg(), b->getIRiReg() )
+	       && sameReg( a->getIRoReg(), b->getIRoReg() );
+}
+
+// run with stderr (where the registers are printed) redirected to 'f'
+static void
+runTo(FILE *f, JtagDumpCtx *c, std::vector<Shift> &v, bool ref)
+{
+int save = dup( 2 );
+
+	fflush( stderr );
+	dup2( fileno( f ), 2 );
+	run( c, v, ref );
+	fflush( stderr );
+	dup2( save, 2 );
+	close( save );
+}
+
+static bool
+sameFile(FILE *a, FILE *b)
+{
+int ca, cb;
+
+	rewind( a );
+	rewind( b );
+	do {
+		ca = getc( a );
+		cb = getc( b );
+	} while ( ca == cb && EOF != ca );
+	return ca == cb;
+}
+
+// Mbit/s of TCK cycles tracked
+static double
+bench(std::vector<Shift> &v, bool quiet, bool ref, unsigned iter)
+{
+JtagDumpCtx c( quiet );
+double      then;
+unsigned long bits = 0;
+unsigned    i;
+FILE       *nul = fopen( "/dev/null", "w" );
+
+	for ( i = 0; i < v.size(); i++ ) {
+		bits += v[i].bits_;
+	}
+	then = now();
+	for ( i = 0; i < iter; i++ ) {
+		runTo( nul, &c, v, ref );
+	}
+	fclose( nul );
+	return (double)bits * (double)iter / (now() - then) / 1.0E6;
+}
+
+int
+main(int argc, char **argv)
+{
+unsigned iter = 20;
+int      rval = 0;
+unsigned i;
+
+	if ( argc > 1 ) {
+		iter = strtoul( argv[1], 0, 0 );
+	}
+
+	// compare the full registers
+	JtagDumpCtx::setDefaultPrintBits( 0 );
+
+	{
+	// many short scans, odd message boundaries; every case of the tables
+	Gen         g( 1237 );
+	JtagDumpCtx r, n;
+	JtagProfile pr, pn;
+	FILE       *fr = tmpfile();
+	FILE       *fn = tmpfile();
+
+		g.session( 20000, 1000 );
+		g.noise( 1000000 );
+		r.setProfile( &pr );
+		n.setProfile( &pn );
+		for ( i = 0; i < g.get().size(); i++ ) {
+			std::vector<Shift> one( 1, g.get()[i] );
+			runTo( fr, &r, one, true  );
+			runTo( fn, &n, one, false );
+			if ( ! same( &r, &n ) ) {
+				fprintf(stderr, "FAILED: tracker state mismatch after shift %u\n", i);
+				rval = 1;
+				break;
+			}
+		}
+		if ( ! sameFile( fr, fn ) ) {
+			fprintf(stderr, "FAILED: sniffer output differs\n");
+			rval = 1;
+		}
+		if ( memcmp( pr.cycles_, pn.cycles_, sizeof(pr.cycles_) ) ) {
+			fprintf(stderr, "FAILED: TCK cycle profile differs\n");
+			rval = 1;
+		}
+		fclose( fr );
+		fclose( fn );
+	}
+
+	{
+	// long data scans in 32k messages (what ILA uploads look like)
+	Gen g( 8*32768 );
+
+		g.session( 400, 20000 );
+		JtagDumpCtx::setDefaultPrintBits( 64 );
+
+		printf("Mbit/s of TCK cycles tracked\n");
+		printf("%-24s %10s %10s\n", "", "per-bit", "table");
+		printf("%-24s %10.1f %10.1f\n", "TAP state only (quiet)",
+			bench( g.get(), true,  true, iter ), bench( g.get(), true,  false, iter ));
+		printf("%-24s %10.1f %10.1f\n", "sniffing (-s)",
+			bench( g.get(), false, true, iter ), bench( g.get(), false, false, iter ));
+	}
+
+	return rval;
+}
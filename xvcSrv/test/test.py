@@ -114,7 +114,12 @@ def playfile(f):
         sd.send(vec)
         tmp=bytearray()
         ser(tmp, arro, byts)
-        got=sd.recv(2000)
+        got=bytearray()
+        while len(got) < len(tmp):
+          b=sd.recv(2000)
+          if len(b) == 0:
+            break
+          got.extend(b)
         if ( got != tmp ):
            if (len(got) != len(tmp)):
              print("Length mismatch: got {} exp {}".format(len(got), len(tmp)))
@@ -123,13 +128,18 @@ def playfile(f):
 
 
 if __name__ == "__main__":
-  (opts, args) = getopt.getopt(sys.argv[1:], "k")
+  (opts, args) = getopt.getopt(sys.argv[1:], "kn:")
   dokill = False
+  runs   = 1
   for (o, a) in opts:
     if o == '-k':
       dokill = True;
+    if o == '-n':
+      runs = int(a)
   try:
-    playfile('testData.txt')
+    # every run is a new connection
+    for i in range(0, runs):
+      playfile('testData.txt')
   except:
     if dokill:
       os.kill( os.getpgid(0), 15 )